@@ -0,0 +1,163 @@
+#include "ActorPool.h"
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+namespace
+{
+	const size_t kCacheLineFloats = 64 / sizeof(float);
+	// actors posed per block; the per-block temporaries stay in L1
+	const size_t kBlockSize = 64;
+	const float kDegToRad = 3.14159265358979323846f / 180.0f;
+}
+
+ActorPool::ActorPool()
+{
+	_count = 0;
+	_capacity = 0;
+	for (int c = 0; c < kColumnCount; c++) { _columns[c] = nullptr; }
+	Reserve(kCacheLineFloats);
+}
+void ActorPool::Reserve(size_t capacity)
+{
+	capacity = (capacity + kCacheLineFloats - 1) / kCacheLineFloats * kCacheLineFloats;
+	std::vector<float> storage(capacity * kColumnCount + kCacheLineFloats);
+	// first column on a cache line boundary; the rest follow whole lines apart
+	uintptr_t address = (uintptr_t)storage.data();
+	float* base = storage.data() + ((64 - address % 64) % 64) / sizeof(float);
+	for (int c = 0; c < kColumnCount; c++)
+	{
+		float* column = base + c * capacity;
+		if (_count) { std::copy(_columns[c], _columns[c] + _count, column); }
+		_columns[c] = column;
+	}
+	_storage.swap(storage);
+	_capacity = capacity;
+}
+size_t ActorPool::Add(float x, float y, float z, float scale, float spin, const float offset[3], const float sway[3])
+{
+	if (_count == _capacity) { Reserve(_capacity * 2); }
+	size_t i = _count++;
+	const float forward[3] = { 0.0f, 0.0f, -1.0f };
+	const float up[3] = { 0.0f, 1.0f, 0.0f };
+	SetOrigin(i, x, y, z);
+	SetOrientation(i, forward, up);
+	_columns[kScale][i] = scale;
+	_columns[kSpin][i] = spin;
+	for (int k = 0; k < 3; k++)
+	{
+		_columns[kOffsetX + k][i] = offset[k];
+		_columns[kSwayX + k][i] = sway[k];
+	}
+	return i;
+}
+void ActorPool::SetOrigin(size_t i, float x, float y, float z)
+{
+	_columns[kOriginX][i] = x;
+	_columns[kOriginY][i] = y;
+	_columns[kOriginZ][i] = z;
+}
+void ActorPool::GetOrigin(size_t i, float origin[3]) const
+{
+	for (int k = 0; k < 3; k++) { origin[k] = _columns[kOriginX + k][i]; }
+}
+void ActorPool::SetOrientation(size_t i, const float forward[3], const float up[3])
+{
+	for (int k = 0; k < 3; k++)
+	{
+		_columns[kForwardX + k][i] = forward[k];
+		_columns[kUpX + k][i] = up[k];
+	}
+}
+void ActorPool::GetOffset(size_t i, float offset[3]) const
+{
+	for (int k = 0; k < 3; k++) { offset[k] = _columns[kOffsetX + k][i]; }
+}
+void ActorPool::GetSway(size_t i, float sway[3]) const
+{
+	for (int k = 0; k < 3; k++) { sway[k] = _columns[kSwayX + k][i]; }
+}
+void ActorPool::BuildMatrices(const int* indices, size_t count, float angle, float wave, float* matrices) const
+{
+	if (!indices) { count = _count; }
+
+	// gather a block into local columns, pose it with straight-line loops the compiler
+	// can vectorize, then scatter the 4x4 matrices out
+	float x[kBlockSize], y[kBlockSize], z[kBlockSize];
+	float fx[kBlockSize], fy[kBlockSize], fz[kBlockSize];
+	float ux[kBlockSize], uy[kBlockSize], uz[kBlockSize];
+	float scale[kBlockSize], sine[kBlockSize], cosine[kBlockSize];
+	float ox[kBlockSize], oy[kBlockSize], oz[kBlockSize];
+	float m[16][kBlockSize];
+
+	// populations mostly share a spin rate, so reuse the last sine and cosine
+	float lastSpin = 0.0f, lastSine = 0.0f, lastCosine = 1.0f;
+
+	for (size_t start = 0; start < count; start += kBlockSize)
+	{
+		size_t n = std::min(kBlockSize, count - start);
+		for (size_t j = 0; j < n; j++)
+		{
+			size_t i = indices ? (size_t)indices[start + j] : start + j;
+			x[j] = _columns[kOriginX][i];
+			y[j] = _columns[kOriginY][i];
+			z[j] = _columns[kOriginZ][i];
+			fx[j] = _columns[kForwardX][i];
+			fy[j] = _columns[kForwardY][i];
+			fz[j] = _columns[kForwardZ][i];
+			ux[j] = _columns[kUpX][i];
+			uy[j] = _columns[kUpY][i];
+			uz[j] = _columns[kUpZ][i];
+			scale[j] = _columns[kScale][i];
+			float spin = _columns[kSpin][i];
+			if (spin != lastSpin)
+			{
+				float radians = spin * angle * kDegToRad;
+				lastSpin = spin;
+				lastSine = sinf(radians);
+				lastCosine = cosf(radians);
+			}
+			sine[j] = lastSine;
+			cosine[j] = lastCosine;
+			ox[j] = _columns[kOffsetX][i] + _columns[kSwayX][i] * wave;
+			oy[j] = _columns[kOffsetY][i] + _columns[kSwayY][i] * wave;
+			oz[j] = _columns[kOffsetZ][i] + _columns[kSwayZ][i] * wave;
+		}
+
+		for (size_t j = 0; j < n; j++)
+		{
+			// frame axes: x = up cross forward, then up and forward, as GLFrame::GetMatrix
+			float rx = uy[j] * fz[j] - uz[j] * fy[j];
+			float ry = uz[j] * fx[j] - ux[j] * fz[j];
+			float rz = ux[j] * fy[j] - uy[j] * fx[j];
+			float c = cosine[j], s = sine[j], k = scale[j];
+			// rotateY columns are (c, 0, -s), (0, 1, 0) and (s, 0, c)
+			m[0][j] = (c * rx - s * fx[j]) * k;
+			m[1][j] = (c * ry - s * fy[j]) * k;
+			m[2][j] = (c * rz - s * fz[j]) * k;
+			m[3][j] = 0.0f;
+			m[4][j] = ux[j] * k;
+			m[5][j] = uy[j] * k;
+			m[6][j] = uz[j] * k;
+			m[7][j] = 0.0f;
+			m[8][j] = (s * rx + c * fx[j]) * k;
+			m[9][j] = (s * ry + c * fy[j]) * k;
+			m[10][j] = (s * rz + c * fz[j]) * k;
+			m[11][j] = 0.0f;
+			// the offset rotated into the frame, scaled, then moved to the origin
+			float tx = (c * ox[j] + s * oz[j]) * k;
+			float ty = oy[j] * k;
+			float tz = (c * oz[j] - s * ox[j]) * k;
+			m[12][j] = rx * tx + ux[j] * ty + fx[j] * tz + x[j];
+			m[13][j] = ry * tx + uy[j] * ty + fy[j] * tz + y[j];
+			m[14][j] = rz * tx + uz[j] * ty + fz[j] * tz + z[j];
+			m[15][j] = 1.0f;
+		}
+
+		float* out = matrices + start * 16;
+		for (size_t j = 0; j < n; j++)
+		{
+			for (int e = 0; e < 16; e++) { out[j * 16 + e] = m[e][j]; }
+		}
+	}
+}
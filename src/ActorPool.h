@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+// many actors of one kind stored column by column (structure of arrays) so a whole
+// population is posed in one pass. each actor is a frame (origin, forward and up, as
+// GLFrame keeps them) holding a mesh that is scaled, spun about its local y axis and
+// pushed out by an offset:
+//   world = frame * scale * rotateY(spin * angle) * translate(offset + sway * wave)
+// columns start on 64 byte boundaries and are padded to whole cache lines
+class ActorPool
+{
+private:
+	enum Column
+	{
+		kOriginX, kOriginY, kOriginZ,
+		kForwardX, kForwardY, kForwardZ,
+		kUpX, kUpY, kUpZ,
+		kScale, kSpin,
+		kOffsetX, kOffsetY, kOffsetZ,
+		kSwayX, kSwayY, kSwayZ,
+		kColumnCount
+	};
+	std::vector<float> _storage;
+	float* _columns[kColumnCount];
+	size_t _count;
+	size_t _capacity; // floats per column, a multiple of one cache line
+	void Reserve(size_t capacity);
+public:
+	ActorPool();
+	ActorPool(const ActorPool&) = delete;
+	ActorPool& operator=(const ActorPool&) = delete;
+	// adds an actor at (x, y, z) facing -z with +y up, like a new GLFrame; returns its index
+	size_t Add(float x, float y, float z, float scale, float spin, const float offset[3], const float sway[3]);
+	void Clear() { _count = 0; }
+	size_t GetCount() const { return _count; }
+	void SetOrigin(size_t i, float x, float y, float z);
+	void GetOrigin(size_t i, float origin[3]) const;
+	void SetOrientation(size_t i, const float forward[3], const float up[3]);
+	float GetScale(size_t i) const { return _columns[kScale][i]; }
+	void GetOffset(size_t i, float offset[3]) const;
+	void GetSway(size_t i, float sway[3]) const;
+	// writes the column-major world matrix of each listed actor (or of every actor when
+	// indices is null) to matrices, 16 floats apart, for the given spin angle in degrees
+	// and sway amount
+	void BuildMatrices(const int* indices, size_t count, float angle, float wave, float* matrices) const;
+};
@@ -0,0 +1,26 @@
+#include "BenchTexture.h"
+
+const char* const kBenchTextureFiles[2] = { "./tga/grass.tga", "./texture/black_rect.jpg" };
+
+BenchTexture::BenchTexture()
+{
+	_texture = 0;
+	_maxSize = 0;
+}
+BenchTexture::~BenchTexture()
+{
+	if (_texture != 0) { glDeleteTextures(1, &_texture); }
+}
+bool BenchTexture::Create()
+{
+	if (!_context.Create(64, 64)) { return false; }
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &_maxSize);
+	glGenTextures(1, &_texture);
+	glBindTexture(GL_TEXTURE_2D, _texture);
+	return true;
+}
+void BenchTexture::Upload(const TextureImage& image) const
+{
+	TextureLoader::UploadChain(image, (size_t)image.chain.pixels.data(), _maxSize);
+	glFinish();
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "gltools.h"
+#include "HeadlessContext.h"
+#include "TextureLoader.h"
+// what the texture benchmarks (--bench-mipmaps, --bench-dxt) share: the images they run on,
+// and a small offscreen context with one texture bound for them to upload into
+
+// a small targa and a large jpg, the two decoders the scene's textures go through
+extern const char* const kBenchTextureFiles[2];
+
+class BenchTexture
+{
+private:
+	HeadlessContext _context;
+	GLuint _texture;
+	GLint _maxSize;
+	BenchTexture(const BenchTexture&) = delete;
+	BenchTexture& operator=(const BenchTexture&) = delete;
+public:
+	BenchTexture();
+	~BenchTexture();
+	// creates the context and binds the texture; prints the reason and returns false on failure
+	bool Create();
+	// every level of image from client memory into the bound texture, through the loader's own
+	// upload, blocking until gl is done with it
+	void Upload(const TextureImage& image) const;
+};
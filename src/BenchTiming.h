@@ -0,0 +1,18 @@
+#pragma once
+#include <chrono>
+#include <algorithm>
+// timing shared by the --bench-* runs
+
+// best of repeats, in ms; the best run is the least disturbed one
+template <typename F> double TimeBest(int repeats, F run)
+{
+	double best = 1e30;
+	for (int r = 0; r < repeats; r++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		run();
+		auto end = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	return best;
+}
@@ -0,0 +1,107 @@
+#include "DxtBench.h"
+#include "BenchTiming.h"
+#include "DxtCompressor.h"
+#include "BenchTexture.h"
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+namespace
+{
+	// level 0 of blocks decoded back to BGRA
+	std::vector<GLubyte> DecompressLevel(const MipChain& blocks, GLenum internalFormat)
+	{
+		const MipLevel& mip = blocks.levels[0];
+		std::vector<GLubyte> image((size_t)mip.width * mip.height * 4);
+		size_t blockBytes = internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? 16 : 8;
+		const GLubyte* block = &blocks.pixels[mip.offset];
+		GLubyte pixels[64];
+		for (int blockY = 0; blockY < mip.height; blockY += 4)
+		{
+			for (int blockX = 0; blockX < mip.width; blockX += 4, block += blockBytes)
+			{
+				DecompressDxtBlock(block, internalFormat, pixels);
+				for (int i = 0; i < 16; i++)
+				{
+					int x = blockX + i % 4, y = blockY + i / 4;
+					if (x < mip.width && y < mip.height) { std::copy(pixels + i * 4, pixels + i * 4 + 4, &image[((size_t)y * mip.width + x) * 4]); }
+				}
+			}
+		}
+		return image;
+	}
+	// peak signal to noise ratio of the color bytes, in dB, and the largest difference
+	double ColorError(const GLubyte* a, const GLubyte* b, size_t pixels, int& worst)
+	{
+		double squared = 0.0;
+		worst = 0;
+		for (size_t i = 0; i < pixels * 4; i++)
+		{
+			if (i % 4 == 3) { continue; }
+			int difference = abs((int)a[i] - (int)b[i]);
+			squared += difference * difference;
+			worst = std::max(worst, difference);
+		}
+		double mean = squared / (pixels * 3);
+		return mean > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mean) : 99.0;
+	}
+}
+
+int RunDxtBenchmark(int repeats)
+{
+	BenchTexture bench;
+	if (!bench.Create()) { return 1; }
+	bool s3tc = GLEE_ARB_texture_compression && GLEE_EXT_texture_compression_s3tc;
+	std::cout << "bench dxt: best of " << repeats << (s3tc ? "" : ", gl has no S3TC so nothing is uploaded compressed") << std::endl;
+	bool ok = true;
+	for (const char* file : kBenchTextureFiles)
+	{
+		TextureImage image;
+		double decodeMs = TimeBest(repeats, [&]() { image = TextureLoader::Decode(file, false, false); });
+		if (image.chain.levels.empty() || image.chain.channels != 4)
+		{
+			std::cout << "bench dxt: cannot load " << file << " in color" << std::endl;
+			ok = false;
+			continue;
+		}
+		const MipLevel& base = image.chain.levels[0];
+		GLenum internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		TextureImage compressed = image;
+		compressed.internalFormat = internalFormat;
+		compressed.compressed = true;
+		double compressMs = TimeBest(repeats, [&]() { CompressMipChain(image.chain, internalFormat, compressed.chain); });
+		// written here if it is missing or stale, read back by the timed runs
+		TextureImage cached = TextureLoader::Decode(file, false, true);
+		double cachedMs = TimeBest(repeats, [&]() { cached = TextureLoader::Decode(file, false, true); });
+		bool same = cached.cached && cached.chain.pixels == compressed.chain.pixels;
+		ok = ok && same;
+		std::cout << "bench dxt " << file << " " << base.width << "x" << base.height << ": decode and mipmap " << decodeMs
+			<< " ms, compress " << compressMs << " ms, read from cache " << cachedMs << " ms (" << decodeMs / cachedMs << "x faster than decoding)"
+			<< (same ? "" : ", MISMATCH against the cache") << std::endl;
+
+		std::vector<GLubyte> decoded = DecompressLevel(compressed.chain, internalFormat);
+		int worst = 0;
+		double psnr = ColorError(decoded.data(), &image.chain.pixels[base.offset], decoded.size() / 4, worst);
+		std::cout << "bench dxt " << file << ": " << image.chain.pixels.size() / 1024 << " KB of pixels to " << compressed.chain.pixels.size() / 1024
+			<< " KB of DXT1 (" << (double)image.chain.pixels.size() / compressed.chain.pixels.size() << "x), level 0 PSNR " << psnr
+			<< " dB, largest error " << worst << std::endl;
+
+		if (!s3tc) { continue; }
+		double pixelUploadMs = TimeBest(repeats, [&]() { bench.Upload(image); });
+		double blockUploadMs = TimeBest(repeats, [&]() { bench.Upload(compressed); });
+		GLint stored = 0;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED_IMAGE_SIZE_ARB, &stored);
+		// gl's own decoding of the blocks, which rounds its interpolated colors its own way
+		std::vector<GLubyte> glDecoded(decoded.size());
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, glDecoded.data());
+		int glWorst = 0;
+		ColorError(glDecoded.data(), decoded.data(), decoded.size() / 4, glWorst);
+		std::cout << "bench dxt " << file << ": upload pixels " << pixelUploadMs << " ms, blocks " << blockUploadMs << " ms, gl stores level 0 in "
+			<< stored / 1024 << " KB, its decoding is at most " << glWorst << " from DecompressDxtBlock" << std::endl;
+		ok = ok && glWorst <= 2;
+	}
+	return ok ? 0 : 1;
+}
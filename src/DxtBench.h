@@ -0,0 +1,6 @@
+#pragma once
+// benchmark of the S3TC texture cache (--bench-dxt): on the shipped grass.tga and
+// black_rect.jpg, times decoding and mipmapping each image against compressing its chain and
+// against reading the blocks back from its cache, and uploading both ways. reports the
+// error the compression adds and how far gl's decoding of the blocks is from DecompressDxtBlock
+int RunDxtBenchmark(int repeats);
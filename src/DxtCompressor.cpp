@@ -0,0 +1,274 @@
+#include "DxtCompressor.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	const int kPowerIterations = 4;
+	const int kRefinements = 2;
+
+	int Quantize(float value, int top)
+	{
+		int level = (int)(value * top / 255.0f + 0.5f);
+		return std::min(std::max(level, 0), top);
+	}
+	// 5:6:5 with red in the top bits, as the format stores its endpoints
+	int Pack565(const float color[3])
+	{
+		return Quantize(color[0], 31) << 11 | Quantize(color[1], 63) << 5 | Quantize(color[2], 31);
+	}
+	void Unpack565(int packed, int color[3])
+	{
+		int r = packed >> 11 & 31, g = packed >> 5 & 63, b = packed & 31;
+		color[0] = r << 3 | r >> 2;
+		color[1] = g << 2 | g >> 4;
+		color[2] = b << 3 | b >> 2;
+	}
+	// a first endpoint above the second selects four colors, two of them between the endpoints;
+	// otherwise three, the midpoint and black
+	void MakePalette(int c0, int c1, int palette[4][3])
+	{
+		Unpack565(c0, palette[0]);
+		Unpack565(c1, palette[1]);
+		for (int k = 0; k < 3; k++)
+		{
+			if (c0 > c1)
+			{
+				palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+				palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+			}
+			else
+			{
+				palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+				palette[3][k] = 0;
+			}
+		}
+	}
+	int Distance(const int a[3], const int b[3])
+	{
+		int r = a[0] - b[0], g = a[1] - b[1], b2 = a[2] - b[2];
+		return r * r + g * g + b2 * b2;
+	}
+
+	struct ColorBlock
+	{
+		int c0, c1;
+		unsigned indices; // two bits per pixel, the first pixel lowest
+		int error;        // squared, summed over the block
+	};
+	// the endpoints ordered for four colors, and each pixel's nearest one
+	ColorBlock EncodeEndpoints(int c0, int c1, const int pixels[16][3])
+	{
+		ColorBlock block;
+		block.c0 = std::max(c0, c1);
+		block.c1 = std::min(c0, c1);
+		block.indices = 0;
+		block.error = 0;
+		int palette[4][3];
+		MakePalette(block.c0, block.c1, palette);
+		// equal endpoints leave three colors; index 0 is all a flat block needs
+		int choices = block.c0 == block.c1 ? 1 : 4;
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0, bestError = Distance(pixels[i], palette[0]);
+			for (int k = 1; k < choices; k++)
+			{
+				int error = Distance(pixels[i], palette[k]);
+				if (error < bestError) { best = k; bestError = error; }
+			}
+			block.indices |= (unsigned)best << (i * 2);
+			block.error += bestError;
+		}
+		return block;
+	}
+	// the endpoints that best fit the pixels for the indices they were given, by least squares
+	bool FitEndpoints(const int pixels[16][3], unsigned indices, float a[3], float b[3])
+	{
+		const float weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f }; // of the second endpoint
+		float aa = 0.0f, bb = 0.0f, ab = 0.0f, ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++)
+		{
+			float beta = weights[indices >> (i * 2) & 3], alpha = 1.0f - beta;
+			aa += alpha * alpha;
+			bb += beta * beta;
+			ab += alpha * beta;
+			for (int k = 0; k < 3; k++)
+			{
+				ax[k] += alpha * pixels[i][k];
+				bx[k] += beta * pixels[i][k];
+			}
+		}
+		float determinant = aa * bb - ab * ab;
+		if (std::fabs(determinant) < 1e-6f) { return false; }
+		for (int k = 0; k < 3; k++)
+		{
+			a[k] = (ax[k] * bb - bx[k] * ab) / determinant;
+			b[k] = (bx[k] * aa - ax[k] * ab) / determinant;
+		}
+		return true;
+	}
+	// endpoints from the pixels furthest apart along the colors' principal axis, then refitted
+	// to the indices they give while that lowers the error
+	void CompressColorBlock(const int pixels[16][3], GLubyte* out)
+	{
+		float mean[3] = { 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++)
+		{
+			for (int k = 0; k < 3; k++) { mean[k] += pixels[i][k] / 16.0f; }
+		}
+		float covariance[3][3] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			float d[3] = { pixels[i][0] - mean[0], pixels[i][1] - mean[1], pixels[i][2] - mean[2] };
+			for (int j = 0; j < 3; j++)
+			{
+				for (int k = 0; k < 3; k++) { covariance[j][k] += d[j] * d[k]; }
+			}
+		}
+		float axis[3] = { 1.0f, 1.0f, 1.0f };
+		for (int iteration = 0; iteration < kPowerIterations; iteration++)
+		{
+			float next[3];
+			for (int j = 0; j < 3; j++) { next[j] = covariance[j][0] * axis[0] + covariance[j][1] * axis[1] + covariance[j][2] * axis[2]; }
+			float largest = std::max(std::fabs(next[0]), std::max(std::fabs(next[1]), std::fabs(next[2])));
+			if (largest < 1e-6f) { break; } // a flat block, any axis will do
+			for (int j = 0; j < 3; j++) { axis[j] = next[j] / largest; }
+		}
+		int low = 0, high = 0;
+		float lowest = 1e30f, highest = -1e30f;
+		for (int i = 0; i < 16; i++)
+		{
+			float t = pixels[i][0] * axis[0] + pixels[i][1] * axis[1] + pixels[i][2] * axis[2];
+			if (t < lowest) { lowest = t; low = i; }
+			if (t > highest) { highest = t; high = i; }
+		}
+		float a[3] = { (float)pixels[high][0], (float)pixels[high][1], (float)pixels[high][2] };
+		float b[3] = { (float)pixels[low][0], (float)pixels[low][1], (float)pixels[low][2] };
+		ColorBlock best = EncodeEndpoints(Pack565(a), Pack565(b), pixels);
+		for (int refinement = 0; refinement < kRefinements && best.error > 0; refinement++)
+		{
+			// fit the palette order: the second endpoint is the one index 1 stands for
+			if (!FitEndpoints(pixels, best.indices, a, b)) { break; }
+			ColorBlock refined = EncodeEndpoints(Pack565(a), Pack565(b), pixels);
+			if (refined.error >= best.error) { break; }
+			best = refined;
+		}
+		out[0] = (GLubyte)best.c0;
+		out[1] = (GLubyte)(best.c0 >> 8);
+		out[2] = (GLubyte)best.c1;
+		out[3] = (GLubyte)(best.c1 >> 8);
+		for (int k = 0; k < 4; k++) { out[4 + k] = (GLubyte)(best.indices >> (k * 8)); }
+	}
+
+	// eight alphas from a first endpoint above the second, six and 0 and 255 otherwise
+	void MakeAlphaPalette(int a0, int a1, int palette[8])
+	{
+		palette[0] = a0;
+		palette[1] = a1;
+		if (a0 > a1)
+		{
+			for (int k = 2; k < 8; k++) { palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7; }
+		}
+		else
+		{
+			for (int k = 2; k < 6; k++) { palette[k] = ((6 - k) * a0 + (k - 1) * a1) / 5; }
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+	// the alpha range's ends, and three bits per pixel for the nearest of the eight
+	void CompressAlphaBlock(const int alphas[16], GLubyte* out)
+	{
+		int low = 255, high = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			low = std::min(low, alphas[i]);
+			high = std::max(high, alphas[i]);
+		}
+		int palette[8];
+		MakeAlphaPalette(high, low, palette);
+		unsigned long long indices = 0;
+		for (int i = 0; i < 16 && high > low; i++)
+		{
+			int best = 0;
+			for (int k = 1; k < 8; k++)
+			{
+				if (std::abs(alphas[i] - palette[k]) < std::abs(alphas[i] - palette[best])) { best = k; }
+			}
+			indices |= (unsigned long long)best << (i * 3);
+		}
+		out[0] = (GLubyte)high;
+		out[1] = (GLubyte)low;
+		for (int k = 0; k < 6; k++) { out[2 + k] = (GLubyte)(indices >> (k * 8)); }
+	}
+}
+
+size_t DxtLevelSize(GLint width, GLint height, GLenum internalFormat)
+{
+	size_t blockBytes = internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? 16 : 8;
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+}
+void CompressMipChain(const MipChain& chain, GLenum internalFormat, MipChain& compressed)
+{
+	bool alpha = internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	size_t total = 0;
+	for (const MipLevel& mip : chain.levels) { total += DxtLevelSize(mip.width, mip.height, internalFormat); }
+	compressed.channels = chain.channels;
+	compressed.pixels.resize(total);
+	compressed.levels.clear();
+	GLubyte* out = compressed.pixels.data();
+	for (const MipLevel& mip : chain.levels)
+	{
+		compressed.levels.push_back({ mip.width, mip.height, (size_t)(out - compressed.pixels.data()) });
+		const GLubyte* image = &chain.pixels[mip.offset];
+		for (int blockY = 0; blockY < mip.height; blockY += 4)
+		{
+			for (int blockX = 0; blockX < mip.width; blockX += 4)
+			{
+				int pixels[16][3], alphas[16];
+				for (int i = 0; i < 16; i++)
+				{
+					int x = std::min(blockX + i % 4, mip.width - 1), y = std::min(blockY + i / 4, mip.height - 1);
+					const GLubyte* p = image + ((size_t)y * mip.width + x) * 4;
+					pixels[i][0] = p[2];
+					pixels[i][1] = p[1];
+					pixels[i][2] = p[0];
+					alphas[i] = p[3];
+				}
+				if (alpha)
+				{
+					CompressAlphaBlock(alphas, out);
+					out += 8;
+				}
+				CompressColorBlock(pixels, out);
+				out += 8;
+			}
+		}
+	}
+}
+void DecompressDxtBlock(const GLubyte* block, GLenum internalFormat, GLubyte pixels[64])
+{
+	int alphaPalette[8];
+	unsigned long long alphaIndices = 0;
+	bool alpha = internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	if (alpha)
+	{
+		MakeAlphaPalette(block[0], block[1], alphaPalette);
+		for (int k = 0; k < 6; k++) { alphaIndices |= (unsigned long long)block[2 + k] << (k * 8); }
+		block += 8;
+	}
+	int c0 = block[0] | block[1] << 8, c1 = block[2] | block[3] << 8;
+	unsigned indices = block[4] | block[5] << 8 | block[6] << 16 | (unsigned)block[7] << 24;
+	int palette[4][3];
+	MakePalette(c0, c1, palette);
+	for (int i = 0; i < 16; i++)
+	{
+		const int* color = palette[indices >> (i * 2) & 3];
+		GLubyte* p = pixels + i * 4;
+		p[0] = (GLubyte)color[2];
+		p[1] = (GLubyte)color[1];
+		p[2] = (GLubyte)color[0];
+		p[3] = alpha ? (GLubyte)alphaPalette[alphaIndices >> (i * 3) & 7] : 255;
+	}
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+#include "gltools.h"
+#include "MipChain.h"
+// S3TC block compression of mip chains, for gl with EXT_texture_compression_s3tc. every 4x4
+// block of a level becomes 8 bytes of DXT1 color, or 16 bytes of DXT5 with an alpha block in
+// front; blocks over the edge of a level repeat its last row and column
+
+// bytes a level of width x height takes in internalFormat, GL_COMPRESSED_RGB_S3TC_DXT1_EXT or
+// GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+size_t DxtLevelSize(GLint width, GLint height, GLenum internalFormat);
+// compresses every level of a 4 channel chain. compressed keeps the sizes of chain's levels,
+// with offsets into its blocks
+void CompressMipChain(const MipChain& chain, GLenum internalFormat, MipChain& compressed);
+// the 16 BGRA pixels of one block, row by row, as gl decodes them; for checking the compressor
+void DecompressDxtBlock(const GLubyte* block, GLenum internalFormat, GLubyte pixels[64]);
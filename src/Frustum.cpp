@@ -0,0 +1,169 @@
+#include "Frustum.h"
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_SSE
+#include <emmintrin.h>
+#endif
+
+Frustum::Frustum()
+{
+	// everything visible until extracted
+	for (int i = 0; i < 6; i++)
+	{
+		_planes[i][0] = _planes[i][1] = _planes[i][2] = 0.0f;
+		_planes[i][3] = 1.0f;
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		_boundsMin[i] = -FLT_MAX;
+		_boundsMax[i] = FLT_MAX;
+	}
+}
+void Frustum::Extract(const M3DMatrix44f projection, const M3DMatrix44f view)
+{
+	M3DMatrix44f clip, unproject;
+	int i, j;
+
+	// Gribb/Hartmann: each plane is the w row plus or minus the x, y or z row of the clip matrix
+	m3dMatrixMultiply44(clip, projection, view);
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 4; j++)
+		{
+			_planes[i * 2][j] = clip[j * 4 + 3] + clip[j * 4 + i];
+			_planes[i * 2 + 1][j] = clip[j * 4 + 3] - clip[j * 4 + i];
+		}
+	}
+	for (i = 0; i < 6; i++)
+	{
+		float length = sqrtf(_planes[i][0] * _planes[i][0] + _planes[i][1] * _planes[i][1] + _planes[i][2] * _planes[i][2]);
+		if (length > 0.0f)
+		{
+			for (j = 0; j < 4; j++) { _planes[i][j] /= length; }
+		}
+	}
+
+	// corners are the clip cube's corners taken back to world space
+	for (i = 0; i < 3; i++)
+	{
+		_boundsMin[i] = -FLT_MAX;
+		_boundsMax[i] = FLT_MAX;
+	}
+	if (!m3dInvertMatrix44(unproject, clip)) { return; }
+	for (i = 0; i < 3; i++)
+	{
+		_boundsMin[i] = FLT_MAX;
+		_boundsMax[i] = -FLT_MAX;
+	}
+	for (int corner = 0; corner < 8; corner++)
+	{
+		M3DVector4f ndc = { corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, corner & 4 ? 1.0f : -1.0f, 1.0f };
+		M3DVector4f world;
+		m3dTransformVector4(world, ndc, unproject);
+		for (i = 0; i < 3; i++)
+		{
+			float v = world[i] / world[3];
+			_boundsMin[i] = std::min(_boundsMin[i], v);
+			_boundsMax[i] = std::max(_boundsMax[i], v);
+		}
+	}
+}
+bool Frustum::TestSphere(float x, float y, float z, float radius) const
+{
+	for (int i = 0; i < 6; i++)
+	{
+		if (_planes[i][0] * x + _planes[i][1] * y + _planes[i][2] * z + _planes[i][3] < -radius) { return false; }
+	}
+	return true;
+}
+bool Frustum::TestBox(const float boxMin[3], const float boxMax[3]) const
+{
+	for (int i = 0; i < 6; i++)
+	{
+		// the corner furthest along the plane normal
+		float x = _planes[i][0] > 0.0f ? boxMax[0] : boxMin[0];
+		float y = _planes[i][1] > 0.0f ? boxMax[1] : boxMin[1];
+		float z = _planes[i][2] > 0.0f ? boxMax[2] : boxMin[2];
+		if (_planes[i][0] * x + _planes[i][1] * y + _planes[i][2] * z + _planes[i][3] < 0.0f) { return false; }
+	}
+	return true;
+}
+size_t Frustum::TestSpheres(const float* x, const float* y, const float* z, const float* radius, size_t count, unsigned char* visible) const
+{
+	size_t i = 0, visibleCount = 0;
+#ifdef FRUSTUM_SSE
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 sx = _mm_loadu_ps(x + i);
+		__m128 sy = _mm_loadu_ps(y + i);
+		__m128 sz = _mm_loadu_ps(z + i);
+		__m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(_planes[p][0]), sx), _mm_mul_ps(_mm_set1_ps(_planes[p][1]), sy)),
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(_planes[p][2]), sz), _mm_set1_ps(_planes[p][3])));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+		}
+		int mask = _mm_movemask_ps(inside);
+		for (int k = 0; k < 4; k++)
+		{
+			visible[i + k] = (unsigned char)((mask >> k) & 1);
+			visibleCount += visible[i + k];
+		}
+	}
+#endif
+	for (; i < count; i++)
+	{
+		visible[i] = TestSphere(x[i], y[i], z[i], radius[i]) ? 1 : 0;
+		visibleCount += visible[i];
+	}
+	return visibleCount;
+}
+
+bool GetShadowSphere(const float plane[4], const float light[4], const float sphere[4], float shadow[4])
+{
+	if (light[3] == 0.0f) { return false; }
+
+	// heights above the plane, signed so the light is on the positive side
+	float lx = light[0] / light[3], ly = light[1] / light[3], lz = light[2] / light[3];
+	float lightHeight = plane[0] * lx + plane[1] * ly + plane[2] * lz + plane[3];
+	float side = lightHeight < 0.0f ? -1.0f : 1.0f;
+	lightHeight *= side;
+	float height = side * (plane[0] * sphere[0] + plane[1] * sphere[1] + plane[2] * sphere[2] + plane[3]);
+	float radius = sphere[3];
+	if (height + radius >= lightHeight * 0.999f) { return false; }
+
+	// a point at height h lands on light + (point - light) * f(h), f(h) = lightHeight / (lightHeight - h);
+	// the sphere's points spread around the projected center by at most the range of f over its heights
+	float f = lightHeight / (lightHeight - height);
+	float fHigh = lightHeight / (lightHeight - (height + radius));
+	float fLow = lightHeight / (lightHeight - (height - radius));
+	float dx = sphere[0] - lx, dy = sphere[1] - ly, dz = sphere[2] - lz;
+	shadow[0] = lx + dx * f;
+	shadow[1] = ly + dy * f;
+	shadow[2] = lz + dz * f;
+	shadow[3] = sqrtf(dx * dx + dy * dy + dz * dz) * (fHigh - fLow) + radius * fHigh;
+	return true;
+}
+void MergeSpheres(const float a[4], const float b[4], float merged[4])
+{
+	float dx = b[0] - a[0], dy = b[1] - a[1], dz = b[2] - a[2];
+	float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+	const float* inner = a[3] < b[3] ? a : b;
+	const float* outer = a[3] < b[3] ? b : a;
+	if (distance + inner[3] <= outer[3])
+	{
+		for (int i = 0; i < 4; i++) { merged[i] = outer[i]; }
+		return;
+	}
+	float radius = (distance + a[3] + b[3]) * 0.5f;
+	float t = (radius - a[3]) / distance; // distance > 0 here, or one sphere would hold the other
+	merged[0] = a[0] + dx * t;
+	merged[1] = a[1] + dy * t;
+	merged[2] = a[2] + dz * t;
+	merged[3] = radius;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include "math3d.h"
+// the six clip planes of a projection * view transform in world space,
+// normalized with their normals pointing into the visible volume
+class Frustum
+{
+private:
+	float _planes[6][4]; // left, right, bottom, top, near, far
+	float _boundsMin[3], _boundsMax[3]; // box around the eight corners
+public:
+	Frustum();
+	void Extract(const M3DMatrix44f projection, const M3DMatrix44f view);
+	const float* GetPlane(int i) const { return _planes[i]; }
+	const float* GetBoundsMin() const { return _boundsMin; }
+	const float* GetBoundsMax() const { return _boundsMax; }
+	bool TestSphere(float x, float y, float z, float radius) const;
+	bool TestBox(const float boxMin[3], const float boxMax[3]) const;
+	// tests count spheres given as separate coordinate and radius arrays, four at a time
+	// with SSE where available; visible[i] becomes 1 when sphere i touches the frustum
+	// and 0 otherwise. returns how many are visible
+	size_t TestSpheres(const float* x, const float* y, const float* z, const float* radius, size_t count, unsigned char* visible) const;
+};
+
+// bounds the planar shadow that sphere (x, y, z, radius) casts onto plane from a point
+// light (w != 0), as projected by m3dMakePlanarShadowMatrix. returns false when the
+// shadow has no bound: a directional light, or the sphere reaching the light's height
+bool GetShadowSphere(const float plane[4], const float light[4], const float sphere[4], float shadow[4]);
+// radius for shadows that cannot be bounded (caster at or above the light)
+const float kUnboundedRadius = 1.0e30f;
+// smallest sphere holding both spheres (x, y, z, radius)
+void MergeSpheres(const float a[4], const float b[4], float merged[4]);
@@ -0,0 +1,160 @@
+#include "HeadlessContext.h"
+#include <iostream>
+#include <cstring>
+#if defined(HEADLESS_OSMESA)
+#include <GL/osmesa.h>
+#elif !defined(_WIN32)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+HeadlessContext::HeadlessContext()
+{
+	_width = 0;
+	_height = 0;
+	_display = nullptr;
+	_surface = nullptr;
+	_context = nullptr;
+	_buffer = nullptr;
+}
+HeadlessContext::~HeadlessContext()
+{
+	Destroy();
+}
+
+#if defined(HEADLESS_OSMESA)
+
+bool HeadlessContext::Create(int width, int height)
+{
+	Destroy();
+	OSMesaContext context = OSMesaCreateContextExt(OSMESA_RGBA, 24, 8, 0, NULL);
+	if (!context)
+	{
+		std::cout << "headless: OSMesaCreateContextExt failed" << std::endl;
+		return false;
+	}
+	_buffer = new unsigned char[(size_t)width * height * 4];
+	if (!OSMesaMakeCurrent(context, _buffer, GL_UNSIGNED_BYTE, width, height))
+	{
+		std::cout << "headless: OSMesaMakeCurrent failed" << std::endl;
+		OSMesaDestroyContext(context);
+		delete[] _buffer;
+		_buffer = nullptr;
+		return false;
+	}
+	_context = context;
+	_width = width;
+	_height = height;
+	return true;
+}
+void HeadlessContext::Destroy()
+{
+	if (_context)
+	{
+		OSMesaDestroyContext((OSMesaContext)_context);
+		_context = nullptr;
+	}
+	delete[] _buffer;
+	_buffer = nullptr;
+}
+
+#elif !defined(_WIN32)
+
+namespace
+{
+	// prefers the surfaceless platform so no X server or GPU is needed,
+	// then falls back to whatever the default display is
+	EGLDisplay GetHeadlessDisplay()
+	{
+		const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		if (extensions && strstr(extensions, "EGL_MESA_platform_surfaceless"))
+		{
+			PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+				(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+			if (getPlatformDisplay)
+			{
+				EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+				if (display != EGL_NO_DISPLAY) { return display; }
+			}
+		}
+		return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+}
+
+bool HeadlessContext::Create(int width, int height)
+{
+	Destroy();
+	EGLDisplay display = GetHeadlessDisplay();
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+	{
+		std::cout << "headless: no EGL display available" << std::endl;
+		return false;
+	}
+	_display = display;
+
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 24, EGL_STENCIL_SIZE, 8,
+		EGL_NONE };
+	EGLConfig config;
+	EGLint configCount = 0;
+	if (!eglChooseConfig(display, configAttribs, &config, 1, &configCount) || configCount == 0)
+	{
+		std::cout << "headless: no EGL config with depth and stencil" << std::endl;
+		Destroy();
+		return false;
+	}
+
+	const EGLint surfaceAttribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+	EGLSurface surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+	if (surface == EGL_NO_SURFACE)
+	{
+		std::cout << "headless: eglCreatePbufferSurface failed" << std::endl;
+		Destroy();
+		return false;
+	}
+	_surface = surface;
+
+	// the scene is fixed-function, so ask for a compatibility (legacy) context
+	eglBindAPI(EGL_OPENGL_API);
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+	if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, surface, surface, context))
+	{
+		std::cout << "headless: cannot create an OpenGL context" << std::endl;
+		if (context != EGL_NO_CONTEXT) { eglDestroyContext(display, context); }
+		Destroy();
+		return false;
+	}
+	_context = context;
+	_width = width;
+	_height = height;
+	return true;
+}
+void HeadlessContext::Destroy()
+{
+	if (!_display) { return; }
+	EGLDisplay display = (EGLDisplay)_display;
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (_context) { eglDestroyContext(display, (EGLContext)_context); }
+	if (_surface) { eglDestroySurface(display, (EGLSurface)_surface); }
+	eglTerminate(display);
+	_context = nullptr;
+	_surface = nullptr;
+	_display = nullptr;
+}
+
+#else
+
+bool HeadlessContext::Create(int width, int height)
+{
+	std::cout << "headless: not supported in this build (needs EGL or HEADLESS_OSMESA)" << std::endl;
+	return false;
+}
+void HeadlessContext::Destroy()
+{
+}
+
+#endif
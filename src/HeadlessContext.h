@@ -0,0 +1,26 @@
+#pragma once
+// offscreen GL context for running the scene without a window or display,
+// backed by EGL pbuffers (surfaceless Mesa/llvmpipe when available) or by
+// OSMesa when built with HEADLESS_OSMESA
+class HeadlessContext
+{
+private:
+	int _width;
+	int _height;
+	void* _display;
+	void* _surface;
+	void* _context;
+	unsigned char* _buffer;
+	HeadlessContext(const HeadlessContext&) = delete;
+	HeadlessContext& operator=(const HeadlessContext&) = delete;
+public:
+	HeadlessContext();
+	~HeadlessContext();
+	// creates the context with an RGBA8 color, 24 bit depth and 8 bit stencil buffer
+	// and makes it current; prints the reason and returns false on failure
+	bool Create(int width, int height);
+	void Destroy();
+	bool IsCreated() const { return _context != nullptr; }
+	int GetWidth() const { return _width; }
+	int GetHeight() const { return _height; }
+};
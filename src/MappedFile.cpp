@@ -0,0 +1,143 @@
+#include "MappedFile.h"
+#include <fstream>
+#include <cstring>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+	_data = nullptr;
+	_size = 0;
+	_mapped = false;
+	_open = false;
+#ifdef _WIN32
+	_file = INVALID_HANDLE_VALUE;
+	_mapping = nullptr;
+#endif
+}
+MappedFile::~MappedFile()
+{
+	Close();
+}
+bool MappedFile::Open(const std::string& filename)
+{
+	Close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		LARGE_INTEGER size;
+		if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+		{
+			HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+			if (view)
+			{
+				_file = file;
+				_mapping = mapping;
+				_data = (const char*)view;
+				_size = (size_t)size.QuadPart;
+				_mapped = true;
+				_open = true;
+				return true;
+			}
+			if (mapping) { CloseHandle(mapping); }
+		}
+		CloseHandle(file);
+	}
+#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd >= 0)
+	{
+		struct stat info;
+		if (fstat(fd, &info) == 0 && info.st_size > 0)
+		{
+			void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (view != MAP_FAILED)
+			{
+				// the mapping keeps its own reference to the file
+				close(fd);
+				_data = (const char*)view;
+				_size = (size_t)info.st_size;
+				_mapped = true;
+				_open = true;
+				return true;
+			}
+		}
+		close(fd);
+	}
+#endif
+	// fall back to a plain read
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (!file) { return false; }
+	_buffer.resize((size_t)file.tellg());
+	file.seekg(0);
+	file.read(_buffer.data(), _buffer.size());
+	_data = _buffer.data();
+	_size = _buffer.size();
+	_open = true;
+	return true;
+}
+void MappedFile::Close()
+{
+	if (_mapped)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(_data);
+		CloseHandle((HANDLE)_mapping);
+		CloseHandle((HANDLE)_file);
+		_file = INVALID_HANDLE_VALUE;
+		_mapping = nullptr;
+#else
+		munmap((void*)_data, _size);
+#endif
+	}
+	_buffer.clear();
+	_data = nullptr;
+	_size = 0;
+	_mapped = false;
+	_open = false;
+}
+
+bool GetFileStamp(const std::string& filename, uint64_t& size, int64_t& time)
+{
+#ifdef _WIN32
+	// _stat64 rounds to seconds, the attributes keep the 100 ns ticks
+	WIN32_FILE_ATTRIBUTE_DATA info;
+	if (!GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &info)) { return false; }
+	size = (uint64_t)info.nFileSizeHigh << 32 | info.nFileSizeLow;
+	time = (int64_t)((uint64_t)info.ftLastWriteTime.dwHighDateTime << 32 | info.ftLastWriteTime.dwLowDateTime) * 100;
+#else
+	struct stat info;
+	if (stat(filename.c_str(), &info) != 0) { return false; }
+	size = (uint64_t)info.st_size;
+#if defined(__APPLE__) || defined(__APPLE_CC__)
+	time = (int64_t)info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+	time = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+#endif
+	return true;
+}
+uint64_t HashBytes(const char* data, size_t size)
+{
+	uint64_t hash = 0x9E3779B97F4A7C15ull ^ size;
+	uint64_t word;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		memcpy(&word, data + i, 8);
+		hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+		hash ^= hash >> 32;
+	}
+	word = 0;
+	memcpy(&word, data + i, size - i);
+	hash = (hash ^ word) * 0xC4CEB9FE1A85EC53ull;
+	return hash ^ (hash >> 29);
+}
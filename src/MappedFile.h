@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+// read-only view of a whole file, memory-mapped when the platform allows it
+// and read into a private buffer otherwise (e.g. empty files)
+class MappedFile
+{
+private:
+	const char* _data;
+	size_t _size;
+	bool _mapped;
+	bool _open;
+#ifdef _WIN32
+	void* _file;
+	void* _mapping;
+#endif
+	std::vector<char> _buffer;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+public:
+	MappedFile();
+	~MappedFile();
+	bool Open(const std::string& filename);
+	void Close();
+	const char* Data() const { return _data; }
+	size_t Size() const { return _size; }
+	bool IsOpen() const { return _open; }
+};
+
+// size and modification time of filename, the time in nanoseconds as finely as the file system
+// keeps it (whole seconds would let an edit in the same second as a cache write go unnoticed).
+// false if it cannot be read
+bool GetFileStamp(const std::string& filename, uint64_t& size, int64_t& time);
+// 64-bit multiply-xorshift over whole words, only used to tell file versions apart
+uint64_t HashBytes(const char* data, size_t size);
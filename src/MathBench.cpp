@@ -0,0 +1,177 @@
+#include "MathBench.h"
+#include "BenchTiming.h"
+#include "math3d.h"
+#include "Matrix44.h"
+#include <iostream>
+#include <random>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const size_t kMatrices = 4096;
+	const size_t kPoints = 65536;
+	const size_t kTriangles = 65536;
+
+	struct BenchData
+	{
+		std::vector<float> parent, locals, points, vertices;
+		std::vector<unsigned int> indices;
+	};
+
+	// largest difference between two arrays of matrices, relative to the larger element
+	float MaxError(const std::vector<float>& a, const std::vector<float>& b)
+	{
+		float worst = 0.0f;
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			worst = std::max(worst, fabsf(a[i] - b[i]) / std::max(1.0f, fabsf(b[i])));
+		}
+		return worst;
+	}
+
+	// the rigid and affine inverses against the general one, on view-like and scaled model matrices
+	bool BenchInverses(int repeats, std::mt19937& random)
+	{
+		const float kTolerance = 1e-4f;
+		std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+		std::vector<float> rigid(kMatrices * 16), affine(kMatrices * 16);
+		for (size_t i = 0; i < kMatrices; i++)
+		{
+			float* m = &rigid[i * 16];
+			M3DVector3f axis = { value(random), value(random), value(random) + 2.0f };
+			m3dNormalizeVector(axis);
+			m3dRotationMatrix44(m, value(random) * 3.14159f, axis[0], axis[1], axis[2]);
+			m[12] = value(random) * 100.0f;
+			m[13] = value(random) * 100.0f;
+			m[14] = value(random) * 100.0f;
+			float* a = &affine[i * 16];
+			for (int k = 0; k < 16; k++) { a[k] = (k % 4 != 3 && k < 12) ? m[k] * (1.5f + value(random)) : m[k]; }
+		}
+
+		bool same = true;
+		std::vector<float> general(kMatrices * 16), special(kMatrices * 16);
+		const char* names[2] = { "rigid", "affine" };
+		const std::vector<float>* inputs[2] = { &rigid, &affine };
+		for (int kind = 0; kind < 2; kind++)
+		{
+			const std::vector<float>& src = *inputs[kind];
+			double generalMs = TimeBest(repeats, [&]()
+			{
+				for (size_t i = 0; i < kMatrices; i++) { m3dInvertMatrix44(&general[i * 16], &src[i * 16]); }
+			});
+			double ms = TimeBest(repeats, [&]()
+			{
+				for (size_t i = 0; i < kMatrices; i++)
+				{
+					if (kind == 0) { m3dInvertRigidMatrix44(&special[i * 16], &src[i * 16]); }
+					else { m3dInvertAffineMatrix44(&special[i * 16], &src[i * 16]); }
+				}
+			});
+			float error = MaxError(special, general);
+			std::cout << "bench invert " << names[kind] << ": " << ms << " ms against " << generalMs << " ms general, "
+				<< generalMs / ms << "x, max error " << error << std::endl;
+			same = same && error < kTolerance;
+		}
+
+		// the tagged type has to land on the same routines
+		RigidMatrix44 view(&rigid[0]);
+		AffineMatrix44 model(&affine[0]), modelInverse;
+		Invert(model, modelInverse);
+		GeneralMatrix44 generalView(view), generalInverse;
+		Invert(generalView, generalInverse);
+		RigidMatrix44 viewInverse = Inverse(view);
+		AffineMatrix44 identity = modelInverse * (viewInverse * (view * model));
+		for (int k = 0; k < 16; k++)
+		{
+			same = same && fabsf(identity[k] - (k % 5 == 0 ? 1.0f : 0.0f)) < kTolerance * 100.0f
+				&& fabsf(viewInverse[k] - generalInverse[k]) < kTolerance * 100.0f;
+		}
+		if (!same) { std::cout << "bench invert: MISMATCH against the general inverse" << std::endl; }
+		return same;
+	}
+
+	void Report(const char* kernel, const char* path, double ms, size_t items, double scalarMs, bool same)
+	{
+		std::cout << "bench " << kernel << " " << path << ": " << ms << " ms, "
+			<< items / ms / 1000.0 << " M/s, " << scalarMs / ms << "x";
+		if (!same) { std::cout << ", MISMATCH against scalar"; }
+		std::cout << std::endl;
+	}
+}
+
+int RunMathBenchmark(int repeats)
+{
+	BenchData data;
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> value(-10.0f, 10.0f);
+	auto fill = [&](std::vector<float>& v, size_t n) { v.resize(n); for (float& f : v) { f = value(random); } };
+	fill(data.parent, 16);
+	fill(data.locals, kMatrices * 16);
+	fill(data.points, kPoints * 3);
+	// a grid of quads, so neighbouring triangles share vertices as in a real mesh
+	const unsigned int columns = 256, rows = (unsigned int)(kTriangles / 2 / columns);
+	fill(data.vertices, (columns + 1) * (rows + 1) * 3);
+	for (unsigned int r = 0; r < rows; r++)
+	{
+		for (unsigned int c = 0; c < columns; c++)
+		{
+			unsigned int v = r * (columns + 1) + c;
+			unsigned int quad[6] = { v, v + columns + 1, v + 1, v + 1, v + columns + 1, v + columns + 2 };
+			data.indices.insert(data.indices.end(), quad, quad + 6);
+		}
+	}
+
+	// the current path, one call per item
+	std::vector<float> scalarProducts(kMatrices * 16), scalarPoints(kPoints * 3), scalarNormals(kTriangles * 3);
+	double multiplyMs = TimeBest(repeats, [&]()
+	{
+		for (size_t i = 0; i < kMatrices; i++) { m3dMatrixMultiply44(&scalarProducts[i * 16], data.parent.data(), &data.locals[i * 16]); }
+	});
+	double transformMs = TimeBest(repeats, [&]()
+	{
+		for (size_t i = 0; i < kPoints; i++) { m3dTransformVector3(&scalarPoints[i * 3], &data.points[i * 3], data.parent.data()); }
+	});
+	double normalMs = TimeBest(repeats, [&]()
+	{
+		for (size_t i = 0; i < kTriangles; i++)
+		{
+			const unsigned int* t = &data.indices[i * 3];
+			m3dFindNormal(&scalarNormals[i * 3], &data.vertices[t[0] * 3], &data.vertices[t[1] * 3], &data.vertices[t[2] * 3]);
+		}
+	});
+
+	M3DSimdLevel best = m3dGetSimdLevel();
+	std::cout << "bench: " << kMatrices << " matrices, " << kPoints << " points, " << kTriangles
+		<< " triangles, best of " << repeats << ", cpu supports " << m3dGetSimdLevelName(best) << std::endl;
+	Report("multiply44", "single", multiplyMs, kMatrices, multiplyMs, true);
+	Report("transform3", "single", transformMs, kPoints, transformMs, true);
+	Report("normal", "single", normalMs, kTriangles, normalMs, true);
+
+	bool allSame = true;
+	std::vector<float> products(kMatrices * 16), points(kPoints * 3), normals(kTriangles * 3);
+	for (int level = M3D_SIMD_SCALAR; level <= best; level++)
+	{
+		m3dSetSimdLevel((M3DSimdLevel)level);
+		const char* name = m3dGetSimdLevelName((M3DSimdLevel)level);
+		double ms = TimeBest(repeats, [&]() { m3dMatrixMultiply44Batch(products.data(), data.parent.data(), 0, data.locals.data(), kMatrices); });
+		bool same = memcmp(products.data(), scalarProducts.data(), products.size() * sizeof(float)) == 0;
+		Report("multiply44", name, ms, kMatrices, multiplyMs, same);
+		allSame = allSame && same;
+
+		ms = TimeBest(repeats, [&]() { m3dTransformVector3Batch(points.data(), data.points.data(), data.parent.data(), kPoints); });
+		same = memcmp(points.data(), scalarPoints.data(), points.size() * sizeof(float)) == 0;
+		Report("transform3", name, ms, kPoints, transformMs, same);
+		allSame = allSame && same;
+
+		ms = TimeBest(repeats, [&]() { m3dFindNormalBatch(normals.data(), data.vertices.data(), data.indices.data(), kTriangles); });
+		same = memcmp(normals.data(), scalarNormals.data(), normals.size() * sizeof(float)) == 0;
+		Report("normal", name, ms, kTriangles, normalMs, same);
+		allSame = allSame && same;
+	}
+	m3dSetSimdLevel(best);
+	allSame = BenchInverses(repeats, random) && allSame;
+	return allSame ? 0 : 1;
+}
@@ -0,0 +1,6 @@
+#pragma once
+// microbenchmark of the batched math3d kernels (--bench-math): times the
+// one-at-a-time scalar calls against every SIMD level the CPU supports and
+// checks that each level gives the same results. also times the rigid and
+// affine inverses against m3dInvertMatrix44 and checks they agree with it
+int RunMathBenchmark(int repeats);
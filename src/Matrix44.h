@@ -0,0 +1,65 @@
+#pragma once
+#include <type_traits>
+#include "math3d.h"
+// 4x4 float matrix tagged with what kind of transform it holds, so Invert and
+// operator* pick the cheapest math3d routine that is correct for it. the tag
+// is only a promise made by whoever builds the matrix; nothing checks it
+enum class MatrixKind
+{
+	Rigid,   // rotation and translation (a GLFrame, a view matrix)
+	Affine,  // any 3x3 with translation, bottom row 0 0 0 1 (scaled models)
+	General  // projections, shadow matrices
+};
+
+template <MatrixKind Kind>
+struct Matrix44
+{
+	M3DMatrix44f m;
+
+	Matrix44() { m3dLoadIdentity44(m); }
+	explicit Matrix44(const M3DMatrix44f src) { m3dCopyMatrix44(m, src); }
+	// a rigid matrix is also affine, and every matrix is general, so widening is implicit
+	template <MatrixKind From, typename = typename std::enable_if<(From < Kind)>::type>
+	Matrix44(const Matrix44<From>& other) { m3dCopyMatrix44(m, other.m); }
+
+	operator float*() { return m; }
+	operator const float*() const { return m; }
+};
+
+typedef Matrix44<MatrixKind::Rigid> RigidMatrix44;
+typedef Matrix44<MatrixKind::Affine> AffineMatrix44;
+typedef Matrix44<MatrixKind::General> GeneralMatrix44;
+
+// the product is only as constrained as the looser of the two
+constexpr MatrixKind CombineKinds(MatrixKind a, MatrixKind b) { return a < b ? b : a; }
+
+template <MatrixKind A, MatrixKind B>
+Matrix44<CombineKinds(A, B)> operator*(const Matrix44<A>& a, const Matrix44<B>& b)
+{
+	Matrix44<CombineKinds(A, B)> product;
+	if (CombineKinds(A, B) == MatrixKind::General) { m3dMatrixMultiply44(product.m, a.m, b.m); }
+	else { m3dMatrixMultiplyAffine44(product.m, a.m, b.m); }
+	return product;
+}
+
+// a rigid matrix always has an inverse
+inline RigidMatrix44 Inverse(const RigidMatrix44& src)
+{
+	RigidMatrix44 inverse;
+	m3dInvertRigidMatrix44(inverse.m, src.m);
+	return inverse;
+}
+// false, leaving inverse untouched, when src is singular
+inline bool Invert(const RigidMatrix44& src, RigidMatrix44& inverse)
+{
+	m3dInvertRigidMatrix44(inverse.m, src.m);
+	return true;
+}
+inline bool Invert(const AffineMatrix44& src, AffineMatrix44& inverse)
+{
+	return m3dInvertAffineMatrix44(inverse.m, src.m);
+}
+inline bool Invert(const GeneralMatrix44& src, GeneralMatrix44& inverse)
+{
+	return m3dInvertMatrix44(inverse.m, src.m);
+}
@@ -0,0 +1,263 @@
+#include "MipChain.h"
+#include "math3d.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define MIP_X86
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#define MIP_TARGET(isa)
+#else
+#define MIP_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace
+{
+	// a destination pixel covers at most three source pixels per side: halving an odd side
+	// covers 2 + 1/size of them, and shrinking to a power of two less than 2
+	const int kTaps = 3;
+	struct Taps
+	{
+		int index[kTaps];
+		float weights[kTaps]; // 0 for the taps past the covered area
+	};
+
+	// area weights of the source pixels each destination pixel covers, sourceSize -> size
+	void MakeTaps(int sourceSize, int size, std::vector<Taps>& taps)
+	{
+		taps.resize(size);
+		double scale = (double)sourceSize / size;
+		for (int i = 0; i < size; i++)
+		{
+			double start = i * scale, end = (i + 1) * scale;
+			int first = (int)start;
+			for (int k = 0; k < kTaps; k++)
+			{
+				int pixel = first + k;
+				double covered = std::min(end, pixel + 1.0) - std::max(start, (double)pixel);
+				taps[i].index[k] = std::min(pixel, sourceSize - 1);
+				taps[i].weights[k] = covered > 0.0 ? (float)(covered / scale) : 0.0f;
+			}
+		}
+	}
+
+	// out[i] = weights . (r0[i], r1[i], r2[i]), for the vertical pass
+	void BlendRowsScalar(float* out, const GLubyte* r0, const GLubyte* r1, const GLubyte* r2, const float* weights, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			out[i] = weights[0] * r0[i] + weights[1] * r1[i] + weights[2] * r2[i];
+		}
+	}
+	// the horizontal pass, rounding back to bytes
+	void FilterColumnsScalar(GLubyte* out, const float* row, const Taps* taps, int width, int channels)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			const Taps& t = taps[x];
+			for (int c = 0; c < channels; c++)
+			{
+				float p = t.weights[0] * row[t.index[0] * channels + c] + t.weights[1] * row[t.index[1] * channels + c]
+					+ t.weights[2] * row[t.index[2] * channels + c];
+				out[x * channels + c] = (GLubyte)(int)(p + 0.5f);
+			}
+		}
+	}
+	// the common case of even sides: each output is the rounded mean of a 2x2 block, in
+	// integers. the same bytes the area weights give, as those are exact halves
+	void HalveRowScalar(GLubyte* out, const GLubyte* r0, const GLubyte* r1, int width, int channels)
+	{
+		for (int i = 0; i < width * channels; i++)
+		{
+			int c = (i / channels) * channels + i; // first of the two source pixels, same channel
+			out[i] = (GLubyte)((r0[c] + r0[c + channels] + r1[c] + r1[c + channels] + 2) >> 2);
+		}
+	}
+
+#ifdef MIP_X86
+	// four 4 channel pixels out of the 2x8 block under them per pass
+	MIP_TARGET("sse2") void HalveRowSSE2(GLubyte* out, const GLubyte* r0, const GLubyte* r1, int width)
+	{
+		__m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+		int x = 0;
+		for (; x + 4 <= width; x += 4)
+		{
+			__m128i a0 = _mm_loadu_si128((const __m128i*)(r0 + x * 8)), a1 = _mm_loadu_si128((const __m128i*)(r0 + x * 8 + 16));
+			__m128i b0 = _mm_loadu_si128((const __m128i*)(r1 + x * 8)), b1 = _mm_loadu_si128((const __m128i*)(r1 + x * 8 + 16));
+			// the two rows summed in 16 bits, two pixels per register
+			__m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+			__m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+			__m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+			__m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+			// then each pixel plus its right neighbour
+			__m128i q0 = _mm_add_epi16(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1));
+			__m128i q1 = _mm_add_epi16(_mm_unpacklo_epi64(s2, s3), _mm_unpackhi_epi64(s2, s3));
+			q0 = _mm_srli_epi16(_mm_add_epi16(q0, two), 2);
+			q1 = _mm_srli_epi16(_mm_add_epi16(q1, two), 2);
+			_mm_storeu_si128((__m128i*)(out + x * 4), _mm_packus_epi16(q0, q1));
+		}
+		HalveRowScalar(out + x * 4, r0 + x * 8, r1 + x * 8, width - x, 4);
+	}
+	MIP_TARGET("sse2") inline void WidenBytes(__m128i bytes, __m128 floats[4])
+	{
+		__m128i zero = _mm_setzero_si128();
+		__m128i low = _mm_unpacklo_epi8(bytes, zero), high = _mm_unpackhi_epi8(bytes, zero);
+		floats[0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero));
+		floats[1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero));
+		floats[2] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero));
+		floats[3] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero));
+	}
+	// sixteen bytes of each row per pass
+	MIP_TARGET("sse2") void BlendRowsSSE2(float* out, const GLubyte* r0, const GLubyte* r1, const GLubyte* r2, const float* weights, size_t count)
+	{
+		__m128 w0 = _mm_set1_ps(weights[0]), w1 = _mm_set1_ps(weights[1]), w2 = _mm_set1_ps(weights[2]);
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128 a[4], b[4], c[4];
+			WidenBytes(_mm_loadu_si128((const __m128i*)(r0 + i)), a);
+			WidenBytes(_mm_loadu_si128((const __m128i*)(r1 + i)), b);
+			WidenBytes(_mm_loadu_si128((const __m128i*)(r2 + i)), c);
+			for (int k = 0; k < 4; k++)
+			{
+				_mm_storeu_ps(out + i + k * 4, _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, a[k]), _mm_mul_ps(w1, b[k])), _mm_mul_ps(w2, c[k])));
+			}
+		}
+		BlendRowsScalar(out + i, r0 + i, r1 + i, r2 + i, weights, count - i);
+	}
+	// one 4 channel pixel per register, rounded to ints
+	MIP_TARGET("sse2") inline __m128i FilterPixel(const float* row, const Taps& t)
+	{
+		__m128 p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.weights[0]), _mm_loadu_ps(row + t.index[0] * 4)),
+			_mm_mul_ps(_mm_set1_ps(t.weights[1]), _mm_loadu_ps(row + t.index[1] * 4))),
+			_mm_mul_ps(_mm_set1_ps(t.weights[2]), _mm_loadu_ps(row + t.index[2] * 4)));
+		return _mm_cvttps_epi32(_mm_add_ps(p, _mm_set1_ps(0.5f)));
+	}
+	// four pixels per pass, packed into one sixteen byte store
+	MIP_TARGET("sse2") void FilterColumnsSSE2(GLubyte* out, const float* row, const Taps* taps, int width)
+	{
+		int x = 0;
+		for (; x + 4 <= width; x += 4)
+		{
+			__m128i p01 = _mm_packs_epi32(FilterPixel(row, taps[x]), FilterPixel(row, taps[x + 1]));
+			__m128i p23 = _mm_packs_epi32(FilterPixel(row, taps[x + 2]), FilterPixel(row, taps[x + 3]));
+			_mm_storeu_si128((__m128i*)(out + x * 4), _mm_packus_epi16(p01, p23));
+		}
+		FilterColumnsScalar(out + x * 4, row, taps + x, width - x, 4);
+	}
+#endif
+
+	void Resample(const GLubyte* source, int sourceWidth, int sourceHeight, GLubyte* out, int width, int height, int channels)
+	{
+		std::vector<Taps> columns, rows;
+		MakeTaps(sourceWidth, width, columns);
+		MakeTaps(sourceHeight, height, rows);
+		std::vector<float> blended((size_t)sourceWidth * channels);
+		size_t sourceRow = (size_t)sourceWidth * channels, row = (size_t)width * channels;
+#ifdef MIP_X86
+		bool sse2 = m3dGetSimdLevel() >= M3D_SIMD_SSE2;
+#endif
+		for (int y = 0; y < height; y++)
+		{
+			const Taps& t = rows[y];
+			const GLubyte* r0 = source + t.index[0] * sourceRow;
+			const GLubyte* r1 = source + t.index[1] * sourceRow;
+			const GLubyte* r2 = source + t.index[2] * sourceRow;
+#ifdef MIP_X86
+			if (sse2)
+			{
+				BlendRowsSSE2(blended.data(), r0, r1, r2, t.weights, sourceRow);
+				if (channels == 4) { FilterColumnsSSE2(out + y * row, blended.data(), columns.data(), width); }
+				else { FilterColumnsScalar(out + y * row, blended.data(), columns.data(), width, channels); }
+				continue;
+			}
+#endif
+			BlendRowsScalar(blended.data(), r0, r1, r2, t.weights, sourceRow);
+			FilterColumnsScalar(out + y * row, blended.data(), columns.data(), width, channels);
+		}
+	}
+	void Halve(const GLubyte* source, GLubyte* out, int width, int height, int channels)
+	{
+		size_t sourceRow = (size_t)width * 2 * channels, row = (size_t)width * channels;
+#ifdef MIP_X86
+		bool sse2 = m3dGetSimdLevel() >= M3D_SIMD_SSE2 && channels == 4;
+#endif
+		for (int y = 0; y < height; y++)
+		{
+			const GLubyte* r0 = source + 2 * y * sourceRow;
+#ifdef MIP_X86
+			if (sse2)
+			{
+				HalveRowSSE2(out + y * row, r0, r0 + sourceRow, width);
+				continue;
+			}
+#endif
+			HalveRowScalar(out + y * row, r0, r0 + sourceRow, width, channels);
+		}
+	}
+	void ExpandToFour(GLubyte* out, const GLubyte* in, size_t count)
+	{
+		for (size_t i = 0; i < count; i++, in += 3, out += 4)
+		{
+			out[0] = in[0];
+			out[1] = in[1];
+			out[2] = in[2];
+			out[3] = 255;
+		}
+	}
+}
+
+int FloorPowerOfTwo(int size)
+{
+	int power = 1;
+	while (power * 2 <= size) { power *= 2; }
+	return power;
+}
+void FlipRows(GLubyte* pixels, size_t rowBytes, int rows)
+{
+	for (int top = 0, bottom = rows - 1; top < bottom; top++, bottom--)
+	{
+		std::swap_ranges(pixels + top * rowBytes, pixels + (top + 1) * rowBytes, pixels + bottom * rowBytes);
+	}
+}
+
+void BuildMipChain(const GLubyte* image, int imageWidth, int imageHeight, int channels, int width, int height, MipChain& chain)
+{
+	chain.channels = channels == 3 ? 4 : channels;
+	chain.levels.clear();
+	size_t total = 0;
+	for (int w = width, h = height; ; w = std::max(1, w / 2), h = std::max(1, h / 2))
+	{
+		MipLevel level = { w, h, total };
+		chain.levels.push_back(level);
+		total += (size_t)w * h * chain.channels;
+		if (w == 1 && h == 1) { break; }
+	}
+	chain.pixels.resize(total);
+
+	bool resized = width != imageWidth || height != imageHeight;
+	std::vector<GLubyte> expanded;
+	const GLubyte* source = image;
+	if (channels == 3 && resized)
+	{
+		expanded.resize((size_t)imageWidth * imageHeight * 4);
+		ExpandToFour(expanded.data(), image, (size_t)imageWidth * imageHeight);
+		source = expanded.data();
+	}
+	if (resized) { Resample(source, imageWidth, imageHeight, chain.pixels.data(), width, height, chain.channels); }
+	else if (channels == 3) { ExpandToFour(chain.pixels.data(), image, (size_t)width * height); }
+	else { memcpy(chain.pixels.data(), image, (size_t)width * height * channels); }
+	for (size_t i = 1; i < chain.levels.size(); i++)
+	{
+		const MipLevel& from = chain.levels[i - 1];
+		const MipLevel& to = chain.levels[i];
+		if (from.width == to.width * 2 && from.height == to.height * 2)
+		{
+			Halve(chain.pixels.data() + from.offset, chain.pixels.data() + to.offset, to.width, to.height, chain.channels);
+			continue;
+		}
+		Resample(chain.pixels.data() + from.offset, from.width, from.height, chain.pixels.data() + to.offset, to.width, to.height, chain.channels);
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include "gltools.h"
+struct MipLevel
+{
+	GLint width;
+	GLint height;
+	size_t offset; // of the level's first byte in MipChain::pixels
+};
+// every level of an 8 bit texture, finest first, each with its rows bottom up and packed
+struct MipChain
+{
+	GLint channels; // 1 or 4
+	std::vector<GLubyte> pixels;
+	std::vector<MipLevel> levels;
+};
+
+// builds the whole chain on the calling thread. level 0 is image resampled to width x height
+// (no more than halving each side), or copied when the sizes match, and every level after it
+// halves both sides, rounding down, until it is 1x1. each output pixel averages the source
+// area it covers, so odd sides shrink without shifting the image. 3 channel images gain an
+// alpha of 255, which keeps pixels 4 bytes wide for the SSE2 kernels; those are used when
+// m3dGetSimdLevel allows and give the same bytes as the scalar ones
+void BuildMipChain(const GLubyte* image, int imageWidth, int imageHeight, int channels, int width, int height, MipChain& chain);
+// largest power of two no bigger than size, for gl without non power of two textures
+int FloorPowerOfTwo(int size);
+// turns an image upside down in place, swapping rows pairwise instead of copying it into a
+// second image; for decoders that hand rows over top first
+void FlipRows(GLubyte* pixels, size_t rowBytes, int rows);
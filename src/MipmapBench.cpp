@@ -0,0 +1,100 @@
+#include "MipmapBench.h"
+#include "BenchTiming.h"
+#include "MipChain.h"
+#include "BenchTexture.h"
+#include "math3d.h"
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+namespace
+{
+	// largest difference of any color byte between chain and the levels glu left in the bound
+	// texture, -1 when glu resized the image
+	int CompareWithGlu(const MipChain& chain)
+	{
+		int worst = 0;
+		std::vector<GLubyte> level;
+		for (size_t i = 0; i < chain.levels.size(); i++)
+		{
+			const MipLevel& mip = chain.levels[i];
+			GLint width = 0, height = 0;
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, (GLint)i, GL_TEXTURE_WIDTH, &width);
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, (GLint)i, GL_TEXTURE_HEIGHT, &height);
+			if (width != mip.width || height != mip.height) { return -1; }
+			level.resize((size_t)width * height * 4);
+			glPixelStorei(GL_PACK_ALIGNMENT, 1);
+			glGetTexImage(GL_TEXTURE_2D, (GLint)i, GL_BGRA_EXT, GL_UNSIGNED_BYTE, level.data());
+			for (size_t b = 0; b < level.size(); b++)
+			{
+				if (b % 4 != 3) { worst = std::max(worst, abs((int)level[b] - (int)chain.pixels[mip.offset + b])); }
+			}
+		}
+		return worst;
+	}
+}
+
+int RunMipmapBenchmark(int repeats)
+{
+	BenchTexture bench;
+	if (!bench.Create()) { return 1; }
+
+	M3DSimdLevel best = m3dGetSimdLevel();
+	std::cout << "bench mipmaps: best of " << repeats << ", cpu supports " << m3dGetSimdLevelName(best) << std::endl;
+	bool allSame = true;
+	for (const char* file : kBenchTextureFiles)
+	{
+		// level 0 of a chain is the decoded image itself, as 4 channels
+		TextureImage image = TextureLoader::Decode(file, false, false);
+		if (image.chain.levels.empty())
+		{
+			std::cout << "bench mipmaps: cannot load " << file << std::endl;
+			allSame = false;
+			continue;
+		}
+		const MipLevel& base = image.chain.levels[0];
+		std::vector<GLubyte> source(image.chain.pixels.begin(), image.chain.pixels.begin() + (size_t)base.width * base.height * 4);
+
+		double gluMs = TimeBest(repeats, [&]()
+		{
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGB8, base.width, base.height, GL_BGRA_EXT, GL_UNSIGNED_BYTE, source.data());
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			glFinish();
+		});
+		GLint gluWidth = 0, gluHeight = 0;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &gluWidth);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &gluHeight);
+		std::cout << "bench mipmaps " << file << " " << base.width << "x" << base.height << ": gluBuild2DMipmaps "
+			<< gluMs << " ms, from " << gluWidth << "x" << gluHeight << std::endl;
+
+		MipChain chain, scalarChain;
+		double scalarMs = 0.0;
+		for (int level = M3D_SIMD_SCALAR; level <= best; level++)
+		{
+			m3dSetSimdLevel((M3DSimdLevel)level);
+			double ms = TimeBest(repeats, [&]() { BuildMipChain(source.data(), base.width, base.height, 4, base.width, base.height, chain); });
+			if (level == M3D_SIMD_SCALAR)
+			{
+				scalarMs = ms;
+				scalarChain = chain;
+			}
+			bool same = chain.pixels == scalarChain.pixels;
+			allSame = allSame && same;
+			std::cout << "bench mipmaps " << file << " build " << m3dGetSimdLevelName((M3DSimdLevel)level) << ": " << ms << " ms, "
+				<< scalarMs / ms << "x scalar, " << gluMs / ms << "x glu" << (same ? "" : ", MISMATCH against scalar") << std::endl;
+		}
+		m3dSetSimdLevel(best);
+		TextureImage built = image;
+		built.chain = chain;
+		double uploadMs = TimeBest(repeats, [&]() { bench.Upload(built); });
+		std::cout << "bench mipmaps " << file << " upload " << chain.levels.size() << " levels: " << uploadMs << " ms" << std::endl;
+
+		gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGB8, base.width, base.height, GL_BGRA_EXT, GL_UNSIGNED_BYTE, source.data());
+		int difference = CompareWithGlu(chain);
+		if (difference >= 0) { std::cout << "bench mipmaps " << file << ": largest difference from glu's levels " << difference << std::endl; }
+	}
+	return allSame ? 0 : 1;
+}
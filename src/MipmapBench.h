@@ -0,0 +1,6 @@
+#pragma once
+// benchmark of the mip chain builder (--bench-mipmaps): times gluBuild2DMipmaps against
+// BuildMipChain at every SIMD level the CPU supports, plus uploading its levels, on the
+// shipped grass.tga and black_rect.jpg. checks that every level builds the same bytes and
+// how far the levels are from glu's where glu keeps the size
+int RunMipmapBenchmark(int repeats);
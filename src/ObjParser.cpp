@@ -1,78 +1,1496 @@
 #include "ObjParser.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "math3d.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+namespace
+{
+	// powers of ten that are exact in a double
+	const double kPow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	// below this a chunk costs more to schedule than to parse
+	const size_t kMinChunkSize = 64 * 1024;
+	// one face corner, 1-based and 0 when the attribute is missing. negative file indices are
+	// counted back from the end of the chunk and flagged until the chunk's offsets are known
+	struct ObjCorner
+	{
+		int v, t, n;
+		int relative;
+	};
+	const int kRelativeV = 1, kRelativeT = 2, kRelativeN = 4;
+	// records parsed from one slice of the file, bounding box starts at the origin like LoadFile
+	struct ObjChunk
+	{
+		std::vector<Vec3f> positions;
+		std::vector<Vec2f> texCoords;
+		std::vector<Vec3f> normals;
+		std::vector<ObjCorner> corners; // three per triangle, polygons are fanned
+		float minX = 0, minY = 0, minZ = 0;
+		float maxX = 0, maxY = 0, maxZ = 0;
+	};
+	inline bool IsBlank(char c)
+	{
+		return c == ' ' || c == '\t';
+	}
+	inline const char* SkipSpaces(const char* p, const char* end)
+	{
+		while (p < end && IsBlank(*p)) { p++; }
+		return p;
+	}
+	inline bool IsIndexStart(char c)
+	{
+		return (unsigned)(c - '0') < 10 || c == '-' || c == '+';
+	}
+	inline const char* SkipLine(const char* p, const char* end)
+	{
+		while (p < end && *p != '\n') { p++; }
+		return p < end ? p + 1 : p;
+	}
+	// decimal "[+-]digits[.digits][(e|E)[+-]digits]", missing values read as 0
+	const char* ParseFloat(const char* p, const char* end, float& value)
+	{
+		unsigned long long mantissa = 0;
+		int digits = 0, exponent = 0;
+		bool negative = false;
+		p = SkipSpaces(p, end);
+		const char* start = p;
+		if (p < end && (*p == '-' || *p == '+')) { negative = (*p++ == '-'); }
+		for (; p < end && (unsigned)(*p - '0') < 10; p++)
+		{
+			if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); digits += (mantissa != 0); }
+			else { exponent++; digits++; }
+		}
+		if (p < end && *p == '.')
+		{
+			for (p++; p < end && (unsigned)(*p - '0') < 10; p++)
+			{
+				if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); digits += (mantissa != 0); exponent--; }
+				else { digits++; }
+			}
+		}
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			int sign = 1, power = 0;
+			p++;
+			if (p < end && (*p == '-' || *p == '+')) { sign = (*p++ == '-') ? -1 : 1; }
+			for (; p < end && (unsigned)(*p - '0') < 10; p++) { power = power < 1000 ? power * 10 + (*p - '0') : power; }
+			exponent += sign * power;
+		}
+		if (exponent >= -22 && exponent <= 22)
+		{
+			// at most 19 digits survive, so the double is within ~1e-16 of the decimal value;
+			// that only matters for float rounding when it sits right on a halfway point
+			double result = exponent < 0 ? (double)mantissa / kPow10[-exponent] : (double)mantissa * kPow10[exponent];
+			float rounded = (float)result;
+			double halfway = ((double)rounded + (double)nextafterf(rounded, result > rounded ? INFINITY : -INFINITY)) / 2.0;
+			if (std::abs(result - halfway) > result * 1e-15)
+			{
+				value = negative ? -rounded : rounded;
+				return p;
+			}
+		}
+		// out of the fast range, fall back to a correctly rounded conversion
+		char token[64];
+		size_t length = (size_t)(p - start) < sizeof(token) - 1 ? (size_t)(p - start) : sizeof(token) - 1;
+		memcpy(token, start, length);
+		token[length] = '\0';
+		value = strtof(token, nullptr);
+		return p;
+	}
+	// saturates at INT_MAX, which no index reaches, so an oversized index stays out of range
+	// instead of wrapping into it
+	const char* ParseInt(const char* p, const char* end, int& value)
+	{
+		int64_t result = 0;
+		bool negative = false;
+		p = SkipSpaces(p, end);
+		if (p < end && (*p == '-' || *p == '+')) { negative = (*p++ == '-'); }
+		for (; p < end && (unsigned)(*p - '0') < 10; p++) { result = std::min(result * 10 + (*p - '0'), (int64_t)INT_MAX); }
+		value = negative ? -(int)result : (int)result;
+		return p;
+	}
+	// "v", "v/t", "v//n" or "v/t/n"
+	const char* ParseCorner(const char* p, const char* end, ObjCorner& corner)
+	{
+		corner.t = corner.n = corner.relative = 0;
+		p = ParseInt(p, end, corner.v);
+		if (p < end && *p == '/')
+		{
+			p++;
+			if (p < end && *p != '/') { p = ParseInt(p, end, corner.t); }
+			if (p < end && *p == '/') { p = ParseInt(p + 1, end, corner.n); }
+		}
+		return p;
+	}
+	// binary mesh cache written next to each obj: header, then _vertices, _texCoords, _normals,
+	// _faces, _lods and _lodFaces as stored in memory
+	const char kCacheMagic[4] = { 'O', 'B', 'J', 'C' };
+	// 3: generated normals, 4: optimized triangle and vertex order, 5: lods, 6: none of the
+	// earlier ones, as 2 outlived the change to triangulated polygons and relative indices,
+	// 7: creases split along edges, 8: source time in nanoseconds
+	const uint32_t kCacheVersion = 8;
+	struct MeshCacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		// identity of the source obj
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		uint64_t sourceHash;
+		// contents
+		uint32_t vertexCount;
+		uint32_t texCoordCount; // vertexCount or 0
+		uint32_t normalCount; // vertexCount or 0
+		uint32_t faceCount;
+		float minX, minY, minZ;
+		float maxX, maxY, maxZ;
+		Vec3f origin;
+		Vec3f offset;
+		Vec3f boundingBox;
+		float maxBoundingBoxSide;
+		float creaseAngle; // the generated normals depend on it
+		uint32_t lodCount; // at least 1, level 0 being the faces
+	};
+	static_assert(sizeof(MeshCacheHeader) == 120, "cache header must have no hidden padding");
+	static_assert(sizeof(Vec2f) == 8 && sizeof(Vec3f) == 12 && sizeof(Vec3d) == 12 && sizeof(MeshLod) == 12,
+		"cache arrays are written as raw bytes");
+	// scans "v", "vt", "vn" and "f" records in place, no per-line allocation
+	void ParseRange(const char* begin, const char* end, ObjChunk& chunk)
+	{
+		Vec3f points;
+		Vec2f texCoord;
+		ObjCorner corner, first, previous;
+		const char* p = begin;
+		while (p < end)
+		{
+			p = SkipSpaces(p, end);
+			if (p + 1 < end && IsBlank(p[1]) && p[0] == 'v')
+			{
+				p = ParseFloat(p + 1, end, points.x);
+				p = ParseFloat(p, end, points.y);
+				p = ParseFloat(p, end, points.z);
+				// update min vertex
+				chunk.minX = points.x < chunk.minX ? points.x : chunk.minX;
+				chunk.minY = points.y < chunk.minY ? points.y : chunk.minY;
+				chunk.minZ = points.z < chunk.minZ ? points.z : chunk.minZ;
+				// update max vertex
+				chunk.maxX = points.x > chunk.maxX ? points.x : chunk.maxX;
+				chunk.maxY = points.y > chunk.maxY ? points.y : chunk.maxY;
+				chunk.maxZ = points.z > chunk.maxZ ? points.z : chunk.maxZ;
+				chunk.positions.push_back(points);
+			}
+			else if (p + 2 < end && IsBlank(p[2]) && p[0] == 'v' && p[1] == 't')
+			{
+				p = ParseFloat(p + 2, end, texCoord.x);
+				p = ParseFloat(p, end, texCoord.y);
+				chunk.texCoords.push_back(texCoord);
+			}
+			else if (p + 2 < end && IsBlank(p[2]) && p[0] == 'v' && p[1] == 'n')
+			{
+				p = ParseFloat(p + 2, end, points.x);
+				p = ParseFloat(p, end, points.y);
+				p = ParseFloat(p, end, points.z);
+				chunk.normals.push_back(points);
+			}
+			else if (p + 1 < end && IsBlank(p[1]) && p[0] == 'f')
+			{
+				// fan out polygons of any size: (0, 1, 2), (0, 2, 3), ...
+				int arity = 0;
+				for (p = SkipSpaces(p + 1, end); p < end && IsIndexStart(*p); p = SkipSpaces(p, end))
+				{
+					p = ParseCorner(p, end, corner);
+					if (corner.v < 0) { corner.v += (int)chunk.positions.size() + 1; corner.relative |= kRelativeV; }
+					if (corner.t < 0) { corner.t += (int)chunk.texCoords.size() + 1; corner.relative |= kRelativeT; }
+					if (corner.n < 0) { corner.n += (int)chunk.normals.size() + 1; corner.relative |= kRelativeN; }
+					if (arity == 0) { first = corner; }
+					else if (arity >= 2)
+					{
+						chunk.corners.push_back(first);
+						chunk.corners.push_back(previous);
+						chunk.corners.push_back(corner);
+					}
+					previous = corner;
+					arity++;
+				}
+			}
+			p = SkipLine(p, end);
+		}
+	}
+	// returns where each chunk landed, with the total at the end
+	template <class T>
+	std::vector<size_t> AppendChunks(std::vector<T>& out, const std::vector<ObjChunk>& chunks, std::vector<T> ObjChunk::* field)
+	{
+		// prefix sums give every chunk its place in the final array
+		std::vector<size_t> offsets(chunks.size() + 1, 0);
+		for (size_t i = 0; i < chunks.size(); i++)
+		{
+			offsets[i + 1] = offsets[i] + (chunks[i].*field).size();
+		}
+		out.resize(offsets[chunks.size()]);
+		for (size_t i = 0; i < chunks.size(); i++)
+		{
+			const std::vector<T>& part = chunks[i].*field;
+			if (!part.empty()) { memcpy(&out[offsets[i]], part.data(), part.size() * sizeof(T)); }
+		}
+		return offsets;
+	}
+	inline uint32_t HashCorner(const ObjCorner& corner)
+	{
+		uint32_t hash = (uint32_t)corner.v * 0x9E3779B1u;
+		hash ^= (uint32_t)corner.t * 0x85EBCA77u + (hash << 6) + (hash >> 2);
+		hash ^= (uint32_t)corner.n * 0xC2B2AE3Du + (hash << 6) + (hash >> 2);
+		return hash ^ (hash >> 15);
+	}
+	// turns v/vt/vn corners into one indexed stream where every vertex owns all its attributes.
+	// identical corners share a vertex through an open-addressing table sized once up front.
+	// triangles with a position outside the file are dropped here so drawing never has to check,
+	// returns how many
+	size_t WeldCorners(ObjChunk& all, std::vector<Vec3f>& vertices, std::vector<Vec2f>& texCoords,
+		std::vector<Vec3f>& normals, std::vector<Vec3d>& faces)
+	{
+		size_t cornerCount = all.corners.size();
+		size_t dropped = 0;
+		int positionCount = (int)all.positions.size();
+		bool useTex = false, useNormals = false;
+		for (size_t i = 0; i < cornerCount; i++)
+		{
+			useTex |= all.corners[i].t != 0;
+			useNormals |= all.corners[i].n != 0;
+		}
+		faces.reserve(cornerCount / 3);
+		if (!useTex && !useNormals)
+		{
+			// plain "f a b c" file, the positions already are the vertex stream
+			vertices.swap(all.positions);
+			for (size_t i = 0; i < cornerCount; i += 3)
+			{
+				Vec3d face = { all.corners[i].v - 1, all.corners[i + 1].v - 1, all.corners[i + 2].v - 1 };
+				if ((unsigned)face.a < (unsigned)positionCount && (unsigned)face.b < (unsigned)positionCount
+					&& (unsigned)face.c < (unsigned)positionCount)
+				{
+					faces.push_back(face);
+				}
+				else { dropped++; }
+			}
+			return dropped;
+		}
+
+		size_t capacity = 16;
+		while (capacity < cornerCount * 2) { capacity *= 2; }
+		std::vector<int> slots(capacity, -1);
+		std::vector<ObjCorner> keys;
+		keys.reserve(cornerCount);
+		vertices.reserve(cornerCount);
+		if (useTex) { texCoords.reserve(cornerCount); }
+		if (useNormals) { normals.reserve(cornerCount); }
+		const Vec2f noTexCoord = { 0, 0 };
+		const Vec3f noNormal = { 0, 0, 0 };
+		int welded[3];
+		for (size_t i = 0; i < cornerCount; i += 3)
+		{
+			if ((unsigned)(all.corners[i].v - 1) >= (unsigned)positionCount || (unsigned)(all.corners[i + 1].v - 1) >= (unsigned)positionCount
+				|| (unsigned)(all.corners[i + 2].v - 1) >= (unsigned)positionCount)
+			{
+				dropped++;
+				continue;
+			}
+			for (int k = 0; k < 3; k++)
+			{
+				ObjCorner corner = all.corners[i + k];
+				// attributes the file does not have are dropped from the key
+				if (corner.t < 1 || corner.t > (int)all.texCoords.size()) { corner.t = 0; }
+				if (corner.n < 1 || corner.n > (int)all.normals.size()) { corner.n = 0; }
+				size_t slot = HashCorner(corner) & (capacity - 1);
+				while (slots[slot] >= 0)
+				{
+					const ObjCorner& key = keys[slots[slot]];
+					if (key.v == corner.v && key.t == corner.t && key.n == corner.n) { break; }
+					slot = (slot + 1) & (capacity - 1);
+				}
+				if (slots[slot] < 0)
+				{
+					slots[slot] = (int)keys.size();
+					keys.push_back(corner);
+					vertices.push_back(all.positions[corner.v - 1]);
+					if (useTex) { texCoords.push_back(corner.t ? all.texCoords[corner.t - 1] : noTexCoord); }
+					if (useNormals) { normals.push_back(corner.n ? all.normals[corner.n - 1] : noNormal); }
+				}
+				welded[k] = slots[slot];
+			}
+			Vec3d face = { welded[0], welded[1], welded[2] };
+			faces.push_back(face);
+		}
+		// the reserves assumed no sharing at all
+		vertices.shrink_to_fit();
+		texCoords.shrink_to_fit();
+		normals.shrink_to_fit();
+		return dropped;
+	}
+	// runs body(begin, end) over [0, count) in pieces on the shared pool, or inline when
+	// count is too small to be worth splitting
+	template <class F>
+	void ParallelFor(size_t count, size_t minChunk, F body)
+	{
+		ThreadPool& pool = ThreadPool::Shared();
+		size_t chunk = count / (pool.GetThreadCount() * 4);
+		chunk = chunk > minChunk ? chunk : minChunk;
+		if (chunk >= count)
+		{
+			body((size_t)0, count);
+			return;
+		}
+		std::vector<std::future<void>> pending;
+		for (size_t begin = 0; begin < count; begin += chunk)
+		{
+			size_t end = begin + chunk < count ? begin + chunk : count;
+			pending.push_back(pool.Submit([&body, begin, end]() { body(begin, end); }));
+		}
+		for (std::future<void>& task : pending)
+		{
+			task.get();
+		}
+	}
+	inline float Dot(const Vec3f& a, const Vec3f& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+	// numbers the distinct exact xyz of the vertices through an open-addressing table like
+	// WeldCorners, so vertices split for texcoords or normals share a number. returns how many
+	size_t NumberPositions(const std::vector<Vec3f>& vertices, std::vector<int>& positionOf)
+	{
+		size_t vertexCount = vertices.size();
+		size_t capacity = 16;
+		while (capacity < vertexCount * 2) { capacity *= 2; }
+		std::vector<int> table(capacity, -1);
+		positionOf.resize(vertexCount);
+		size_t positionCount = 0;
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			// + 0.0f folds -0 into 0 before hashing the bits
+			float key[3] = { vertices[v].x + 0.0f, vertices[v].y + 0.0f, vertices[v].z + 0.0f };
+			uint32_t bits[3];
+			memcpy(bits, key, sizeof(bits));
+			uint32_t hash = bits[0] * 0x9E3779B1u;
+			hash ^= bits[1] * 0x85EBCA77u + (hash << 6) + (hash >> 2);
+			hash ^= bits[2] * 0xC2B2AE3Du + (hash << 6) + (hash >> 2);
+			size_t slot = (hash ^ (hash >> 15)) & (capacity - 1);
+			while (table[slot] >= 0)
+			{
+				const Vec3f& other = vertices[table[slot]];
+				if (other.x == key[0] && other.y == key[1] && other.z == key[2]) { break; }
+				slot = (slot + 1) & (capacity - 1);
+			}
+			if (table[slot] < 0)
+			{
+				table[slot] = (int)v;
+				positionOf[v] = (int)positionCount++;
+			}
+			else { positionOf[v] = positionOf[table[slot]]; }
+		}
+		return positionCount;
+	}
+	// root of corner's smoothing group, halving the path to it on the way
+	int FindGroup(std::vector<int>& groupOf, int corner)
+	{
+		while (groupOf[corner] != corner)
+		{
+			groupOf[corner] = groupOf[groupOf[corner]];
+			corner = groupOf[corner];
+		}
+		return corner;
+	}
+	// the lower root becomes the root of both, so a group's root is its lowest corner
+	void JoinGroups(std::vector<int>& groupOf, int a, int b)
+	{
+		a = FindGroup(groupOf, a);
+		b = FindGroup(groupOf, b);
+		if (a != b) { groupOf[std::max(a, b)] = std::min(a, b); }
+	}
+	// area weighted smooth normals for objs that have none. the corners at a position fall into
+	// smoothing groups: two faces sharing an edge there join across it when their normals are
+	// within creaseAngle degrees, and every corner gets the sum of its group's face normals
+	// (unnormalized, so twice the face area). corners of one vertex in different groups are
+	// split into extra vertices so hard edges stay hard. a position is an exact xyz, so vertices
+	// split for texcoords or repeated in the file still smooth together. linear in the faces:
+	// edges are matched through one table and groups kept as a union-find over the corners, and
+	// the per-position passes run in parallel since each only writes its own corners and vertices
+	void GenerateNormals(std::vector<Vec3f>& vertices, std::vector<Vec2f>& texCoords, std::vector<Vec3f>& normals,
+		std::vector<Vec3d>& faces, float creaseAngle)
+	{
+		const size_t kMinChunk = 2048;
+		size_t vertexCount = vertices.size();
+		size_t cornerCount = faces.size() * 3;
+		int* corners = &faces[0].a; // Vec3d is three packed ints
+		bool smoothAll = creaseAngle >= 180.0f;
+		float cosCrease = cosf(creaseAngle * 3.14159265f / 180.0f);
+
+		std::vector<Vec3f> faceNormals(faces.size());
+		ParallelFor(faces.size(), kMinChunk, [&](size_t begin, size_t end)
+		{
+			m3dFindNormalBatch(&faceNormals[begin].x, &vertices[0].x, (const unsigned int*)&faces[begin].a, end - begin);
+		});
+
+		std::vector<int> positionOf;
+		size_t positionCount = NumberPositions(vertices, positionOf);
+
+		// corners grouped by position, in corner order: those of position p are
+		// slots[first[p]] .. slots[first[p + 1] - 1]
+		std::vector<int> first(positionCount + 1, 0), slots(cornerCount);
+		auto positionOfCorner = [&](size_t c) { return positionOf[corners[c]]; };
+		for (size_t c = 0; c < cornerCount; c++) { first[positionOfCorner(c) + 1]++; }
+		for (size_t p = 0; p < positionCount; p++) { first[p + 1] += first[p]; }
+		std::vector<int> cursor(first.begin(), first.end() - 1);
+		for (size_t c = 0; c < cornerCount; c++) { slots[cursor[positionOfCorner(c)]++] = (int)c; }
+
+		// without a crease every position is one group. otherwise each edge is looked up by its
+		// two positions in an open-addressing table holding, for every face on it, the corner it
+		// starts at; a face joins each earlier one there at both ends unless they bend too far.
+		// edges of more than two faces (doubled or non-manifold surfaces) are rare and small
+		std::vector<int> groupOf(cornerCount);
+		for (size_t c = 0; c < cornerCount; c++) { groupOf[c] = smoothAll ? slots[first[positionOfCorner(c)]] : (int)c; }
+		if (!smoothAll)
+		{
+			size_t capacity = 16;
+			while (capacity < cornerCount * 2) { capacity *= 2; }
+			std::vector<int> table(capacity, -1);
+			auto nextCorner = [](int c) { return c % 3 == 2 ? c - 2 : c + 1; };
+			for (int c = 0; c < (int)cornerCount; c++)
+			{
+				int from = positionOfCorner(c), to = positionOfCorner(nextCorner(c));
+				if (from == to) { continue; } // a degenerate edge borders nothing
+				const Vec3f& own = faceNormals[c / 3];
+				float ownLength = sqrtf(Dot(own, own));
+				uint64_t key = from < to ? (uint64_t)from << 32 | (uint32_t)to : (uint64_t)to << 32 | (uint32_t)from;
+				size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & (capacity - 1);
+				for (; table[slot] >= 0; slot = (slot + 1) & (capacity - 1))
+				{
+					int other = table[slot], otherFrom = positionOfCorner(other), otherTo = positionOfCorner(nextCorner(other));
+					bool sameWay = otherFrom == from && otherTo == to;
+					if (!sameWay && (otherFrom != to || otherTo != from)) { continue; }
+					const Vec3f& n = faceNormals[other / 3];
+					if (Dot(own, n) < cosCrease * ownLength * sqrtf(Dot(n, n))) { continue; }
+					JoinGroups(groupOf, c, sameWay ? other : nextCorner(other));
+					JoinGroups(groupOf, nextCorner(c), sameWay ? nextCorner(other) : other);
+				}
+				table[slot] = c;
+			}
+		}
+
+		// every group lies within one position, so each position's pass only touches its own
+		// groups. the sums gather at the roots, and groupNext chains a group's corners in order
+		// starting from the root, which is also the group's first slot
+		std::vector<Vec3f> groupNormals(cornerCount);
+		std::vector<int> groupNext(cornerCount, -1);
+		ParallelFor(positionCount, kMinChunk, [&](size_t begin, size_t end)
+		{
+			for (size_t p = begin; p < end; p++)
+			{
+				for (int s = first[p]; s < first[p + 1]; s++)
+				{
+					int c = slots[s], root = FindGroup(groupOf, c);
+					groupOf[c] = root;
+					const Vec3f& n = faceNormals[c / 3];
+					Vec3f& sum = groupNormals[root];
+					sum.x += n.x; sum.y += n.y; sum.z += n.z;
+				}
+				for (int s = first[p + 1] - 1; s >= first[p]; s--)
+				{
+					int c = slots[s], root = groupOf[c];
+					if (c != root)
+					{
+						groupNext[c] = groupNext[root];
+						groupNext[root] = c;
+						continue;
+					}
+					Vec3f& sum = groupNormals[root];
+					float length = sqrtf(Dot(sum, sum));
+					if (length > 0.0f) { sum.x /= length; sum.y /= length; sum.z /= length; }
+				}
+			}
+		});
+
+		// the first group to reach a vertex keeps it, every later one gets a copy shared by its
+		// corners there. copies are numbered within their position until extra is summed up
+		std::vector<int> assigned(cornerCount), vertexGroup(vertexCount, -1), vertexCopy(vertexCount);
+		std::vector<int> extra(positionCount + 1, 0);
+		ParallelFor(positionCount, kMinChunk, [&](size_t begin, size_t end)
+		{
+			for (size_t p = begin; p < end; p++)
+			{
+				for (int s = first[p]; s < first[p + 1]; s++)
+				{
+					int root = slots[s];
+					if (groupOf[root] != root) { continue; }
+					for (int c = root; c >= 0; c = groupNext[c])
+					{
+						int vertex = corners[c];
+						if (vertexGroup[vertex] != root)
+						{
+							vertexCopy[vertex] = vertexGroup[vertex] < 0 ? vertex : (int)vertexCount + extra[p + 1]++;
+							vertexGroup[vertex] = root;
+						}
+						assigned[c] = vertexCopy[vertex];
+					}
+				}
+			}
+		});
+		for (size_t p = 0; p < positionCount; p++) { extra[p + 1] += extra[p]; }
+
+		size_t total = vertexCount + extra[positionCount];
+		vertices.resize(total);
+		if (!texCoords.empty()) { texCoords.resize(total); }
+		normals.resize(total);
+		ParallelFor(positionCount, kMinChunk, [&](size_t begin, size_t end)
+		{
+			for (size_t p = begin; p < end; p++)
+			{
+				for (int s = first[p]; s < first[p + 1]; s++)
+				{
+					int c = slots[s], vertex = corners[c], target = assigned[c];
+					if (target >= (int)vertexCount)
+					{
+						target += extra[p];
+						vertices[target] = vertices[vertex];
+						if (!texCoords.empty()) { texCoords[target] = texCoords[vertex]; }
+					}
+					normals[target] = groupNormals[groupOf[c]];
+					corners[c] = target;
+				}
+			}
+		});
+	}
+	// post-transform cache the triangle order is tuned for and measured against, a FIFO
+	// about the size of the ones in the hardware we run on
+	const int kVertexCacheSize = 16;
+	struct VertexCacheStats
+	{
+		float acmr; // cache misses per triangle, 0.5 is the ideal for a large grid, 3 the worst
+		float atvr; // cache misses per vertex used, 1 is the ideal
+	};
+	VertexCacheStats MeasureVertexCache(const std::vector<Vec3d>& faces, size_t vertexCount)
+	{
+		// a vertex is in the FIFO while fewer than kVertexCacheSize misses came after its own
+		const int kNever = -kVertexCacheSize - 1;
+		std::vector<int> missedAt(vertexCount, kNever);
+		int misses = 0, used = 0;
+		for (const Vec3d& face : faces)
+		{
+			const int corners[3] = { face.a, face.b, face.c };
+			for (int k = 0; k < 3; k++)
+			{
+				int& time = missedAt[corners[k]];
+				if (misses - time <= kVertexCacheSize) { continue; }
+				used += time == kNever;
+				time = misses++;
+			}
+		}
+		VertexCacheStats stats;
+		stats.acmr = faces.empty() ? 0.0f : (float)misses / faces.size();
+		stats.atvr = used == 0 ? 0.0f : (float)misses / used;
+		return stats;
+	}
+	// Tipsify (Sander, Nehab and Barczak 2007): fans the triangles around one vertex at a time,
+	// moving to the neighbour that will still be in the cache when its triangles are done.
+	// each jump to an unrelated vertex flushes the cache, and the triangles between two jumps
+	// form a cluster. the clusters are then ordered to face outwards first, so the front of
+	// the mesh tends to be drawn before what it hides. linear in the face count
+	void OptimizeFaceOrder(std::vector<Vec3d>& faces, const std::vector<Vec3f>& vertices)
+	{
+		size_t faceCount = faces.size();
+		size_t vertexCount = vertices.size();
+		const int* corners = &faces[0].a;
+
+		// triangles around vertex v are adjacent[first[v]] .. adjacent[first[v + 1] - 1]
+		std::vector<int> first(vertexCount + 1, 0), adjacent(faceCount * 3), live(vertexCount, 0);
+		for (size_t c = 0; c < faceCount * 3; c++) { live[corners[c]]++; }
+		for (size_t v = 0; v < vertexCount; v++) { first[v + 1] = first[v] + live[v]; }
+		std::vector<int> cursor(first.begin(), first.end() - 1);
+		for (size_t c = 0; c < faceCount * 3; c++) { adjacent[cursor[corners[c]]++] = (int)(c / 3); }
+
+		std::vector<int> cacheTime(vertexCount, 0), order, clusterStarts, candidates, deadEnd;
+		std::vector<char> emitted(faceCount, 0);
+		order.reserve(faceCount);
+		deadEnd.reserve(faceCount * 3);
+		int time = kVertexCacheSize + 1;
+		size_t scan = 0; // vertices below this have no triangles left
+		int fan = -1;
+		auto skipDeadEnd = [&]()
+		{
+			while (!deadEnd.empty())
+			{
+				int v = deadEnd.back();
+				deadEnd.pop_back();
+				if (live[v] > 0) { return v; }
+			}
+			for (; scan < vertexCount; scan++)
+			{
+				if (live[scan] > 0) { return (int)scan; }
+			}
+			return -1;
+		};
+		fan = skipDeadEnd();
+		if (fan >= 0) { clusterStarts.push_back(0); }
+		while (fan >= 0)
+		{
+			candidates.clear();
+			for (int a = first[fan]; a < first[fan + 1]; a++)
+			{
+				int t = adjacent[a];
+				if (emitted[t]) { continue; }
+				emitted[t] = 1;
+				order.push_back(t);
+				for (int k = 0; k < 3; k++)
+				{
+					int v = corners[t * 3 + k];
+					deadEnd.push_back(v);
+					candidates.push_back(v);
+					live[v]--;
+					if (time - cacheTime[v] > kVertexCacheSize) { cacheTime[v] = time++; }
+				}
+			}
+			// the candidate that stays in the cache longest while its remaining fan is emitted
+			int next = -1, best = -1;
+			for (int v : candidates)
+			{
+				if (live[v] <= 0) { continue; }
+				int priority = 0;
+				if (time - cacheTime[v] + 2 * live[v] <= kVertexCacheSize) { priority = time - cacheTime[v]; }
+				if (priority > best)
+				{
+					best = priority;
+					next = v;
+				}
+			}
+			if (next < 0)
+			{
+				next = skipDeadEnd();
+				if (next >= 0 && order.size() < faceCount) { clusterStarts.push_back((int)order.size()); }
+			}
+			fan = next;
+		}
+		clusterStarts.push_back((int)order.size());
+
+		// outward first: how far the cluster sits from the mesh centre along its own normal
+		Vec3f centre = { 0, 0, 0 };
+		for (const Vec3f& v : vertices) { centre.x += v.x; centre.y += v.y; centre.z += v.z; }
+		if (vertexCount > 0) { centre.x /= vertexCount; centre.y /= vertexCount; centre.z /= vertexCount; }
+		size_t clusterCount = clusterStarts.size() - 1;
+		std::vector<float> facing(clusterCount);
+		std::vector<int> clusters(clusterCount);
+		for (size_t c = 0; c < clusterCount; c++)
+		{
+			Vec3f sum = { 0, 0, 0 }, normal = { 0, 0, 0 };
+			for (int i = clusterStarts[c]; i < clusterStarts[c + 1]; i++)
+			{
+				const Vec3f& p0 = vertices[corners[order[i] * 3]];
+				const Vec3f& p1 = vertices[corners[order[i] * 3 + 1]];
+				const Vec3f& p2 = vertices[corners[order[i] * 3 + 2]];
+				M3DVector3f n;
+				m3dFindNormal(n, &p0.x, &p1.x, &p2.x);
+				normal.x += n[0]; normal.y += n[1]; normal.z += n[2];
+				sum.x += p0.x + p1.x + p2.x; sum.y += p0.y + p1.y + p2.y; sum.z += p0.z + p1.z + p2.z;
+			}
+			float scale = 1.0f / (3 * (clusterStarts[c + 1] - clusterStarts[c]));
+			Vec3f offset = { sum.x * scale - centre.x, sum.y * scale - centre.y, sum.z * scale - centre.z };
+			float length = sqrtf(Dot(normal, normal));
+			facing[c] = length > 0.0f ? Dot(offset, normal) / length : 0.0f;
+			clusters[c] = (int)c;
+		}
+		std::stable_sort(clusters.begin(), clusters.end(), [&](int a, int b) { return facing[a] > facing[b]; });
+
+		std::vector<Vec3d> sorted;
+		sorted.reserve(faceCount);
+		for (int c : clusters)
+		{
+			for (int i = clusterStarts[c]; i < clusterStarts[c + 1]; i++) { sorted.push_back(faces[order[i]]); }
+		}
+		faces.swap(sorted);
+	}
+	// renumbers the vertices in the order the triangles first use them, so drawing walks the
+	// vertex arrays forwards. vertices no triangle uses keep their relative order at the end
+	void OptimizeVertexOrder(std::vector<Vec3f>& vertices, std::vector<Vec2f>& texCoords, std::vector<Vec3f>& normals,
+		std::vector<Vec3d>& faces)
+	{
+		size_t vertexCount = vertices.size();
+		int* corners = &faces[0].a;
+		std::vector<int> remap(vertexCount, -1);
+		int next = 0;
+		for (size_t c = 0; c < faces.size() * 3; c++)
+		{
+			if (remap[corners[c]] < 0) { remap[corners[c]] = next++; }
+			corners[c] = remap[corners[c]];
+		}
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			if (remap[v] < 0) { remap[v] = next++; }
+		}
+		auto permute = [&](auto& values)
+		{
+			if (values.empty()) { return; }
+			typename std::remove_reference<decltype(values)>::type moved(values.size());
+			for (size_t v = 0; v < vertexCount; v++) { moved[remap[v]] = values[v]; }
+			values.swap(moved);
+		};
+		permute(vertices);
+		permute(texCoords);
+		permute(normals);
+	}
+	// the chain has at most kMaxLods levels counting the full mesh, each with about half the
+	// triangles of the one before; it stops early once a level would drop below kMinLodFaces
+	// triangles or when the simplifier cannot get near the target any more
+	const int kMaxLods = 4;
+	const size_t kMinLodFaces = 32;
+	// plane quadric (Garland and Heckbert 1997) summed over the planes around a position,
+	// plus their total weight, so QuadricError is a mean squared distance in model units
+	struct Quadric
+	{
+		double a2, b2, c2, ab, ac, bc, ad, bd, cd, d2;
+		double weight;
+	};
+	void AddPlane(Quadric& q, double a, double b, double c, double d, double weight)
+	{
+		q.a2 += weight * a * a; q.b2 += weight * b * b; q.c2 += weight * c * c;
+		q.ab += weight * a * b; q.ac += weight * a * c; q.bc += weight * b * c;
+		q.ad += weight * a * d; q.bd += weight * b * d; q.cd += weight * c * d;
+		q.d2 += weight * d * d;
+		q.weight += weight;
+	}
+	void AddQuadric(Quadric& q, const Quadric& other)
+	{
+		q.a2 += other.a2; q.b2 += other.b2; q.c2 += other.c2;
+		q.ab += other.ab; q.ac += other.ac; q.bc += other.bc;
+		q.ad += other.ad; q.bd += other.bd; q.cd += other.cd;
+		q.d2 += other.d2;
+		q.weight += other.weight;
+	}
+	double QuadricError(const Quadric& q, const Vec3f& p)
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double e = q.a2 * x * x + q.b2 * y * y + q.c2 * z * z + 2 * (q.ab * x * y + q.ac * x * z + q.bc * y * z)
+			+ 2 * (q.ad * x + q.bd * y + q.cd * z) + q.d2;
+		return q.weight > 0 ? fabs(e) / q.weight : 0;
+	}
+	inline Vec3f Cross(const Vec3f& a, const Vec3f& b)
+	{
+		Vec3f c = { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+		return c;
+	}
+	inline Vec3f FaceNormal(const Vec3f& p0, const Vec3f& p1, const Vec3f& p2)
+	{
+		Vec3f e1 = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+		Vec3f e2 = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+		return Cross(e1, e2);
+	}
+	inline uint64_t EdgeKey(int from, int to)
+	{
+		return ((uint64_t)(uint32_t)from << 32) | (uint32_t)to;
+	}
+	// directed edges between positions, sorted so an edge without its reverse is found as a border
+	void FindEdges(const std::vector<int>& positionOf, const std::vector<Vec3d>& faces, std::vector<uint64_t>& edges)
+	{
+		edges.clear();
+		for (const Vec3d& face : faces)
+		{
+			int p[3] = { positionOf[face.a], positionOf[face.b], positionOf[face.c] };
+			for (int k = 0; k < 3; k++) { edges.push_back(EdgeKey(p[k], p[(k + 1) % 3])); }
+		}
+		std::sort(edges.begin(), edges.end());
+	}
+	inline bool IsBorder(const std::vector<uint64_t>& edges, int from, int to)
+	{
+		return !std::binary_search(edges.begin(), edges.end(), EdgeKey(to, from));
+	}
+	// per position: the planes of the triangles around it, weighted by area, and planes standing
+	// on its open border edges, weighted by length squared so outlines wear away no faster than
+	// the surface
+	std::vector<Quadric> FaceQuadrics(const std::vector<Vec3f>& vertices, const std::vector<int>& positionOf,
+		size_t positionCount, const std::vector<Vec3d>& faces)
+	{
+		std::vector<Quadric> quadrics(positionCount, Quadric());
+		std::vector<uint64_t> edges;
+		FindEdges(positionOf, faces, edges);
+		for (const Vec3d& face : faces)
+		{
+			const int p[3] = { positionOf[face.a], positionOf[face.b], positionOf[face.c] };
+			const Vec3f* points[3] = { &vertices[face.a], &vertices[face.b], &vertices[face.c] };
+			Vec3f n = FaceNormal(*points[0], *points[1], *points[2]);
+			double length = sqrt((double)Dot(n, n));
+			if (length <= 0.0) { continue; }
+			double a = n.x / length, b = n.y / length, c = n.z / length;
+			double d = -(a * points[0]->x + b * points[0]->y + c * points[0]->z);
+			for (int k = 0; k < 3; k++)
+			{
+				AddPlane(quadrics[p[k]], a, b, c, d, length * 0.5);
+				const Vec3f& from = *points[k];
+				const Vec3f& to = *points[(k + 1) % 3];
+				if (!IsBorder(edges, p[k], p[(k + 1) % 3])) { continue; }
+				Vec3f edge = { to.x - from.x, to.y - from.y, to.z - from.z };
+				Vec3f side = Cross(edge, n);
+				double sideLength = sqrt((double)Dot(side, side));
+				if (sideLength <= 0.0) { continue; }
+				double sa = side.x / sideLength, sb = side.y / sideLength, sc = side.z / sideLength;
+				double sd = -(sa * from.x + sb * from.y + sc * from.z);
+				AddPlane(quadrics[p[k]], sa, sb, sc, sd, Dot(edge, edge));
+				AddPlane(quadrics[p[(k + 1) % 3]], sa, sb, sc, sd, Dot(edge, edge));
+			}
+		}
+		return quadrics;
+	}
+	// quadric error edge collapse of faces, in place, down to about targetCount triangles.
+	// vertices only ever move onto a neighbour (half-edge collapse), so every level keeps using
+	// the full mesh's vertex arrays and needs nothing but its own index list. a position moves
+	// onto a neighbouring one when each vertex at it shares a triangle with exactly one vertex
+	// there, which becomes its replacement: vertices split by a texture seam or a crease then
+	// move along the seam, never across it. on an open border a position only moves along the
+	// border. collapses run cheapest first in passes that touch each neighbourhood once.
+	// quadrics carry over between calls, so error, the largest distance (root mean square) a
+	// collapse moved the surface, stays measured from the full mesh
+	void SimplifyFaces(const std::vector<Vec3f>& vertices, const std::vector<int>& positionOf, size_t positionCount,
+		std::vector<Quadric>& quadrics, std::vector<Vec3d>& faces, size_t targetCount, float& error)
+	{
+		// a triangle whose normal turns further than this (cos 75 degrees) blocks the collapse
+		const float kMaxFlip = 0.25f;
+		size_t vertexCount = vertices.size();
+		std::vector<uint64_t> edges;
+		std::vector<int> borderFrom(positionCount), borderTo(positionCount), vertexAt(positionCount);
+		std::vector<int> first(positionCount + 1), adjacent, cursor, remap(vertexCount);
+		std::vector<char> touched(positionCount), pinned(positionCount);
+		std::vector<int> ringU, ringV;
+		std::vector<std::pair<int, int>> moves;
+
+		struct Collapse
+		{
+			int from, to; // positions
+			float cost;
+		};
+		std::vector<Collapse> collapses;
+		while (faces.size() > targetCount)
+		{
+			// positions where open borders meet or end cannot move at all
+			FindEdges(positionOf, faces, edges);
+			std::fill(borderFrom.begin(), borderFrom.end(), -1);
+			std::fill(borderTo.begin(), borderTo.end(), -1);
+			std::fill(touched.begin(), touched.end(), 0);
+			std::fill(pinned.begin(), pinned.end(), 0);
+			for (uint64_t edge : edges)
+			{
+				int from = (int)(edge >> 32), to = (int)(uint32_t)edge;
+				if (!IsBorder(edges, from, to)) { continue; }
+				if (borderTo[from] >= 0) { pinned[from] = 1; }
+				if (borderFrom[to] >= 0) { pinned[to] = 1; }
+				borderTo[from] = to;
+				borderFrom[to] = from;
+			}
+			for (size_t p = 0; p < positionCount; p++)
+			{
+				if ((borderTo[p] >= 0) != (borderFrom[p] >= 0)) { pinned[p] = 1; }
+			}
+			// triangles around position p are adjacent[first[p]] .. adjacent[first[p + 1] - 1]
+			std::fill(first.begin(), first.end(), 0);
+			for (const Vec3d& face : faces)
+			{
+				first[positionOf[face.a] + 1]++;
+				first[positionOf[face.b] + 1]++;
+				first[positionOf[face.c] + 1]++;
+			}
+			for (size_t p = 0; p < positionCount; p++) { first[p + 1] += first[p]; }
+			adjacent.resize(faces.size() * 3);
+			cursor.assign(first.begin(), first.end() - 1);
+			for (size_t f = 0; f < faces.size(); f++)
+			{
+				adjacent[cursor[positionOf[faces[f].a]]++] = (int)f;
+				adjacent[cursor[positionOf[faces[f].b]]++] = (int)f;
+				adjacent[cursor[positionOf[faces[f].c]]++] = (int)f;
+			}
+
+			// the cost needs a vertex at the target position, any will do
+			for (const Vec3d& face : faces)
+			{
+				vertexAt[positionOf[face.a]] = face.a;
+				vertexAt[positionOf[face.b]] = face.b;
+				vertexAt[positionOf[face.c]] = face.c;
+			}
+			// every directed edge once, it is in the edge list once per triangle on it
+			collapses.clear();
+			for (size_t e = 0; e < edges.size(); e++)
+			{
+				if (e > 0 && edges[e] == edges[e - 1]) { continue; }
+				int from = (int)(edges[e] >> 32), to = (int)(uint32_t)edges[e];
+				for (int direction = 0; direction < 2; direction++, std::swap(from, to))
+				{
+					if (from == to || pinned[from]) { continue; }
+					if (borderTo[from] >= 0 && borderTo[from] != to && borderFrom[from] != to) { continue; }
+					// the reverse of an inner edge is in the list as well
+					if (direction == 1 && !IsBorder(edges, to, from)) { continue; }
+					Collapse collapse = { from, to, (float)QuadricError(quadrics[from], vertices[vertexAt[to]]) };
+					collapses.push_back(collapse);
+				}
+			}
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+			for (size_t v = 0; v < vertexCount; v++) { remap[v] = (int)v; }
+			size_t removed = 0, needed = faces.size() - targetCount;
+			for (const Collapse& collapse : collapses)
+			{
+				if (removed >= needed) { break; }
+				int pu = collapse.from, pv = collapse.to;
+				if (touched[pu] || touched[pv]) { continue; }
+				const Vec3f& target = vertices[vertexAt[pv]];
+
+				// pair every vertex at u with the one at v it shares a triangle with. an edge with
+				// more than two triangles on it is not a surface a collapse can keep intact
+				size_t onEdge = 0;
+				moves.clear();
+				ringU.clear();
+				ringV.clear();
+				for (int a = first[pu]; a < first[pu + 1]; a++)
+				{
+					const Vec3d& face = faces[adjacent[a]];
+					const int corners[3] = { face.a, face.b, face.c };
+					int u = -1, v = -1;
+					for (int k = 0; k < 3; k++)
+					{
+						int p = positionOf[corners[k]];
+						if (p == pu) { u = corners[k]; }
+						else if (p == pv) { v = corners[k]; }
+						else { ringU.push_back(p); }
+					}
+					moves.push_back(std::make_pair(u, v));
+					onEdge += v >= 0;
+				}
+				if (onEdge == 0 || onEdge > 2) { continue; }
+				// the pairs of one vertex at u sort together, the ones without a partner (-1) first
+				bool blocked = false;
+				std::sort(moves.begin(), moves.end());
+				for (size_t m = 0; m < moves.size() && !blocked; m++)
+				{
+					bool lastOfVertex = m + 1 == moves.size() || moves[m + 1].first != moves[m].first;
+					bool sameVertex = m > 0 && moves[m - 1].first == moves[m].first;
+					blocked = (lastOfVertex && moves[m].second < 0)
+						|| (sameVertex && moves[m - 1].second >= 0 && moves[m - 1].second != moves[m].second);
+				}
+				if (blocked) { continue; }
+
+				// link condition: u and v may only share the neighbours across the edge's
+				// own triangles, or the surface would pinch into a non-manifold one
+				for (int a = first[pv]; a < first[pv + 1]; a++)
+				{
+					const Vec3d& face = faces[adjacent[a]];
+					const int corners[3] = { face.a, face.b, face.c };
+					for (int k = 0; k < 3; k++)
+					{
+						int p = positionOf[corners[k]];
+						if (p != pu && p != pv) { ringV.push_back(p); }
+					}
+				}
+				std::sort(ringU.begin(), ringU.end());
+				ringU.erase(std::unique(ringU.begin(), ringU.end()), ringU.end());
+				std::sort(ringV.begin(), ringV.end());
+				ringV.erase(std::unique(ringV.begin(), ringV.end()), ringV.end());
+				size_t common = 0;
+				for (int p : ringU) { common += std::binary_search(ringV.begin(), ringV.end(), p); }
+				if (common != onEdge) { continue; }
+
+				// the triangles that stay must not fold over
+				for (int a = first[pu]; a < first[pu + 1] && !blocked; a++)
+				{
+					const Vec3d& face = faces[adjacent[a]];
+					const int corners[3] = { face.a, face.b, face.c };
+					Vec3f before[3], after[3];
+					bool hasV = false;
+					for (int k = 0; k < 3; k++)
+					{
+						int p = positionOf[corners[k]];
+						hasV |= p == pv;
+						before[k] = after[k] = vertices[corners[k]];
+						if (p == pu) { after[k] = target; }
+					}
+					if (hasV) { continue; }
+					Vec3f n0 = FaceNormal(before[0], before[1], before[2]);
+					Vec3f n1 = FaceNormal(after[0], after[1], after[2]);
+					blocked = Dot(n0, n1) < kMaxFlip * sqrtf(Dot(n0, n0) * Dot(n1, n1));
+				}
+				if (blocked) { continue; }
+
+				for (const std::pair<int, int>& move : moves)
+				{
+					if (move.second >= 0) { remap[move.first] = move.second; }
+				}
+				AddQuadric(quadrics[pv], quadrics[pu]);
+				error = std::max(error, sqrtf(collapse.cost));
+				removed += onEdge;
+				touched[pu] = touched[pv] = 1;
+				for (int p : ringU) { touched[p] = 1; }
+			}
+			// folds and non-manifold edges can leave nearly every collapse blocked, and a pass
+			// costs as much whether it finds one or a thousand
+			if (removed == 0 || removed * 100 < needed) { break; }
+
+			// drop the triangles that lost an edge
+			size_t kept = 0;
+			for (const Vec3d& face : faces)
+			{
+				Vec3d moved = { remap[face.a], remap[face.b], remap[face.c] };
+				int p0 = positionOf[moved.a], p1 = positionOf[moved.b], p2 = positionOf[moved.c];
+				if (p0 == p1 || p1 == p2 || p2 == p0) { continue; }
+				faces[kept++] = moved;
+			}
+			faces.resize(kept);
+		}
+	}
+	// levels 1 and up of the chain, each simplified further from the one before and put in
+	// cache order like the full mesh. lods[0] is faces itself
+	void BuildLods(const std::vector<Vec3f>& vertices, const std::vector<Vec3d>& faces,
+		std::vector<Vec3d>& lodFaces, std::vector<MeshLod>& lods)
+	{
+		lodFaces.clear();
+		lods.clear();
+		MeshLod full = { 0, (uint32_t)faces.size(), 0.0f };
+		lods.push_back(full);
+		std::vector<int> positionOf;
+		size_t positionCount = NumberPositions(vertices, positionOf);
+		std::vector<Quadric> quadrics = FaceQuadrics(vertices, positionOf, positionCount, faces);
+		std::vector<Vec3d> level(faces);
+		float error = 0.0f;
+		while ((int)lods.size() < kMaxLods && level.size() / 2 >= kMinLodFaces)
+		{
+			size_t previous = level.size();
+			SimplifyFaces(vertices, positionOf, positionCount, quadrics, level, previous / 2, error);
+			// seams, borders and folds left too little to take away
+			if (level.size() > previous * 3 / 4) { break; }
+			OptimizeFaceOrder(level, vertices);
+			MeshLod lod = { (uint32_t)lodFaces.size(), (uint32_t)level.size(), error };
+			lodFaces.insert(lodFaces.end(), level.begin(), level.end());
+			lods.push_back(lod);
+		}
+	}
+}
+
+namespace
+{
+	// texels per row of the instance matrix texture, a multiple of 4 so a matrix never wraps
+	const GLsizei kInstanceTextureWidth = 1024;
+	// fixed-function transform and single-light lighting, with the model matrix fetched per instance.
+	// normals are not renormalized, matching the scene which leaves GL_NORMALIZE off
+	const char* kInstanceVertexShader =
+		"#version 120\n"
+		"#extension GL_EXT_gpu_shader4 : require\n"
+		"uniform sampler2D instanceMatrices;\n"
+		"uniform bool lighting;\n"
+		"void main()\n"
+		"{\n"
+		"	int texel = gl_InstanceID * 4;\n"
+		"	ivec2 at = ivec2(texel % 1024, texel / 1024);\n"
+		"	mat4 model = mat4(texelFetch2D(instanceMatrices, at, 0), texelFetch2D(instanceMatrices, at + ivec2(1, 0), 0),\n"
+		"		texelFetch2D(instanceMatrices, at + ivec2(2, 0), 0), texelFetch2D(instanceMatrices, at + ivec2(3, 0), 0));\n"
+		"	mat4 modelView = gl_ModelViewMatrix * model;\n"
+		"	vec4 eye = modelView * gl_Vertex;\n"
+		"	gl_Position = gl_ProjectionMatrix * eye;\n"
+		"	gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+		"	if (!lighting)\n"
+		"	{\n"
+		"		gl_FrontColor = gl_Color;\n"
+		"		return;\n"
+		"	}\n"
+		"	mat3 rotation = mat3(modelView);\n"
+		"	vec3 normal = rotation * gl_Normal / dot(rotation[0], rotation[0]);\n"
+		"	vec3 toLight = normalize(gl_LightSource[0].position.xyz - eye.xyz * gl_LightSource[0].position.w);\n"
+		"	float diffuse = max(dot(normal, toLight), 0.0);\n"
+		"	vec4 color = gl_FrontLightModelProduct.sceneColor + gl_FrontLightProduct[0].ambient + gl_FrontLightProduct[0].diffuse * diffuse;\n"
+		"	if (diffuse > 0.0)\n"
+		"	{\n"
+		"		vec3 halfVector = normalize(toLight + vec3(0.0, 0.0, 1.0));\n"
+		"		color += gl_FrontLightProduct[0].specular * pow(max(dot(normal, halfVector), 0.0), gl_FrontMaterial.shininess);\n"
+		"	}\n"
+		"	gl_FrontColor = vec4(clamp(color.rgb, 0.0, 1.0), gl_FrontMaterial.diffuse.a);\n"
+		"}\n";
+	// GL_MODULATE texturing
+	const char* kInstanceFragmentShader =
+		"#version 120\n"
+		"uniform sampler2D colorMap;\n"
+		"uniform bool texturing;\n"
+		"void main()\n"
+		"{\n"
+		"	gl_FragColor = texturing ? gl_Color * texture2D(colorMap, gl_TexCoord[0].st) : gl_Color;\n"
+		"}\n";
+	GLuint CompileShader(GLenum type, const char* source)
+	{
+		GLint compiled = GL_FALSE;
+		GLuint shader = glCreateShader(type);
+		glShaderSource(shader, 1, &source, NULL);
+		glCompileShader(shader);
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+		if (!compiled)
+		{
+			char log[1024];
+			glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+			std::cout << "instancing shader: " << log << std::endl;
+			glDeleteShader(shader);
+			return 0;
+		}
+		return shader;
+	}
+}
+
+constexpr float ObjParser::kDefaultCreaseAngle;
 
 ObjParser::ObjParser(std::string filename)
 {
+	_creaseAngle = kDefaultCreaseAngle;
+	_mesh.ready = _placeholderMesh.ready = false;
+	memset(_displayLists, 0, sizeof(_displayLists));
+	_displayListSetting = kDisplayListsAuto;
 	LoadFile(filename);
 	_pointSize = 4;
 	_lineWidth = 2;
 }
-ObjParser::ObjParser(std::string filename, float pointSize, float lineWidth)
+ObjParser::ObjParser(std::string filename, float pointSize, float lineWidth, float creaseAngle)
 {
+	_creaseAngle = creaseAngle;
+	_mesh.ready = _placeholderMesh.ready = false;
+	memset(_displayLists, 0, sizeof(_displayLists));
+	_displayListSetting = kDisplayListsAuto;
 	LoadFile(filename);
 	if (pointSize > 0) { _pointSize = pointSize; }
 	if (lineWidth > 0) { _lineWidth = lineWidth; }
 }
+ObjParser::~ObjParser()
+{
+	ReleaseMeshes();
+}
 void ObjParser::LoadFile(std::string filename)
 {
+	ReleaseMeshes();
 	_vertices.clear();
+	_texCoords.clear();
+	_normals.clear();
 	_faces.clear();
+	_lodFaces.clear();
+	_lods.clear();
 	_minX = _minY = _minZ = _maxX = _maxY = _maxZ = 0;
 
-	Vec3f points;
-	Vec3d indexes;
-	int u, v, w;
-	float x, y, z;
-	std::ifstream file(filename);
-	std::string line;
-	while (getline(file, line))
-	{
-		if (line.substr(0, 1) == "v")
-		{
-			std::istringstream values(line.substr(2));
-			values >> x; values >> y; values >> z;
-			// update min vertex
-			_minX = x < _minX ? x : _minX;
-			_minY = y < _minY ? y : _minY;
-			_minZ = z < _minZ ? z : _minZ;
-			// update max vertex
-			_maxX = x > _maxX ? x : _maxX;
-			_maxY = y > _maxY ? y : _maxY;
-			_maxZ = z > _maxZ ? z : _maxZ;
-			points.x = x;
-			points.y = y;
-			points.z = z;
-			_vertices.push_back(points);
-		}
-		else if (line.substr(0, 1) == "f")
-		{
-			std::istringstream values(line.substr(2));
-			values >> u; values >> v; values >> w;
-			indexes.a = u - 1;
-			indexes.b = v - 1;
-			indexes.c = w - 1;
-			_faces.push_back(indexes);
-		}
-	}
-	file.close();
-	// calculate origin
-	_origin.x = _minX + _maxX;
-	_origin.y = _minY + _maxY;
-	_origin.z = _minZ + _maxZ;
-	// calculate centroid
-	_offset.x = -(_origin.x) / 2.f;
-	_offset.y = -(_origin.y) / 2.f;
-	_offset.z = -(_origin.z) / 2.f;
-	// calculate bounding box and max size of axis
-	_boundingBox.x = (std::abs(_minX) + std::abs(_maxX)) / 2.f;
-	_boundingBox.y = (std::abs(_minY) + std::abs(_maxY)) / 2.f;
-	_boundingBox.z = (std::abs(_minZ) + std::abs(_maxZ)) / 2.f;
-	_maxBoundingBoxSide = _boundingBox.x > _boundingBox.y ? _boundingBox.x : _boundingBox.y;
-	_maxBoundingBoxSide = _boundingBox.z > _maxBoundingBoxSide ? _boundingBox.z : _maxBoundingBoxSide;
-	// print status
-	std::cout << "origin: " << _origin.x << " " << _origin.y << " " << _origin.z << std::endl;
-	std::cout << "offset: " << _offset.x << " " << _offset.y << " " << _offset.z << std::endl;
-}
-void ObjParser::Draw(GLenum renderMode, bool isTex)
+	auto startTime = std::chrono::high_resolution_clock::now();
+	std::string cacheName = filename + ".cache";
+	uint64_t sourceSize = 0, sourceHash = 0;
+	int64_t sourceTime = 0;
+	bool hasStamp = GetFileStamp(filename, sourceSize, sourceTime);
+	bool hashed = false;
+	bool fromCache = false;
+	size_t rejectedFaces = 0;
+	std::ostringstream optimizeStatus;
+	MappedFile file;
+	MappedFile cache;
+	if (hasStamp && cache.Open(cacheName) && cache.Size() >= sizeof(MeshCacheHeader))
+	{
+		const MeshCacheHeader* header = (const MeshCacheHeader*)cache.Data();
+		if (header->sourceSize == sourceSize && header->sourceTime != sourceTime && file.Open(filename))
+		{
+			// touched but maybe not edited (e.g. a fresh checkout), compare contents
+			sourceHash = HashBytes(file.Data(), file.Size());
+			hashed = true;
+		}
+		if (header->sourceSize == sourceSize && (header->sourceTime == sourceTime || header->sourceHash == sourceHash))
+		{
+			fromCache = ReadCache(cache.Data(), cache.Size());
+		}
+	}
+	cache.Close();
+	if (!fromCache)
+	{
+		// a rejected cache may have filled some of these
+		_vertices.clear();
+		_texCoords.clear();
+		_normals.clear();
+		_faces.clear();
+		_lodFaces.clear();
+		_lods.clear();
+		if (!file.IsOpen() && !file.Open(filename))
+		{
+			std::cout << "cannot open " << filename << std::endl;
+		}
+		rejectedFaces = ParseBuffer(file.Data(), file.Data() + file.Size());
+		if (!_faces.empty())
+		{
+			// once per obj, the cache keeps the result. exporters that already wrote a cache
+			// friendly order (seaweed's strips) keep it
+			std::vector<Vec3d> reordered(_faces);
+			VertexCacheStats before = MeasureVertexCache(_faces, _vertices.size());
+			OptimizeFaceOrder(reordered, _vertices);
+			VertexCacheStats after = MeasureVertexCache(reordered, _vertices.size());
+			bool better = after.acmr < before.acmr;
+			if (better) { _faces.swap(reordered); }
+			OptimizeVertexOrder(_vertices, _texCoords, _normals, _faces);
+			optimizeStatus << "vertex cache " << kVertexCacheSize << ": ACMR " << before.acmr << " -> " << after.acmr
+				<< ", ATVR " << before.atvr << " -> " << after.atvr << (better ? "" : ", kept the file order") << std::endl;
+		}
+		BuildLods(_vertices, _faces, _lodFaces, _lods);
+		// calculate origin
+		_origin.x = _minX + _maxX;
+		_origin.y = _minY + _maxY;
+		_origin.z = _minZ + _maxZ;
+		// calculate centroid
+		_offset.x = -(_origin.x) / 2.f;
+		_offset.y = -(_origin.y) / 2.f;
+		_offset.z = -(_origin.z) / 2.f;
+		// calculate bounding box and max size of axis
+		_boundingBox.x = (std::abs(_minX) + std::abs(_maxX)) / 2.f;
+		_boundingBox.y = (std::abs(_minY) + std::abs(_maxY)) / 2.f;
+		_boundingBox.z = (std::abs(_minZ) + std::abs(_maxZ)) / 2.f;
+		_maxBoundingBoxSide = _boundingBox.x > _boundingBox.y ? _boundingBox.x : _boundingBox.y;
+		_maxBoundingBoxSide = _boundingBox.z > _maxBoundingBoxSide ? _boundingBox.z : _maxBoundingBoxSide;
+		if (hasStamp && file.IsOpen())
+		{
+			if (!hashed) { sourceHash = HashBytes(file.Data(), file.Size()); }
+			WriteCache(cacheName, sourceSize, sourceTime, sourceHash);
+		}
+	}
+	else if (hashed)
+	{
+		// refresh the stamp so the next run skips the hash
+		WriteCache(cacheName, sourceSize, sourceTime, sourceHash);
+	}
+	file.Close();
+	// print status in one write, several files may be loading at once
+	std::ostringstream status;
+	status << filename << (fromCache ? " (cached)" : "") << std::endl;
+	status << "origin: " << _origin.x << " " << _origin.y << " " << _origin.z << std::endl;
+	status << "offset: " << _offset.x << " " << _offset.y << " " << _offset.z << std::endl;
+	if (rejectedFaces > 0) { status << "skipped " << rejectedFaces << " triangles with out of range indices" << std::endl; }
+	status << optimizeStatus.str();
+	if (_lods.size() > 1)
+	{
+		status << "lod triangles (error):";
+		for (size_t i = 0; i < _lods.size(); i++)
+		{
+			status << (i > 0 ? ", " : " ") << _lods[i].faceCount;
+			if (i > 0) { status << " (" << _lods[i].error << ")"; }
+		}
+		status << std::endl;
+	}
+	status << "loaded " << _vertices.size() << " vertices, " << _faces.size() << " faces in "
+		<< std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count() << " ms" << std::endl;
+	std::cout << status.str();
+}
+// fills the mesh straight from a mapped cache file, false if it is stale or damaged
+bool ObjParser::ReadCache(const char* data, size_t size)
+{
+	MeshCacheHeader header;
+	memcpy(&header, data, sizeof(header));
+	size_t vertexBytes = (size_t)header.vertexCount * sizeof(Vec3f);
+	size_t texCoordBytes = (size_t)header.texCoordCount * sizeof(Vec2f);
+	size_t normalBytes = (size_t)header.normalCount * sizeof(Vec3f);
+	size_t faceBytes = (size_t)header.faceCount * sizeof(Vec3d);
+	size_t lodBytes = (size_t)header.lodCount * sizeof(MeshLod);
+	size_t arrayBytes = vertexBytes + texCoordBytes + normalBytes + faceBytes + lodBytes;
+	if (memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 || header.version != kCacheVersion
+		|| header.creaseAngle != _creaseAngle || header.lodCount == 0 || size < sizeof(header) + arrayBytes
+		|| (header.texCoordCount != 0 && header.texCoordCount != header.vertexCount)
+		|| (header.normalCount != 0 && header.normalCount != header.vertexCount))
+	{
+		return false;
+	}
+	const char* p = data + sizeof(header);
+	_vertices.resize(header.vertexCount);
+	_texCoords.resize(header.texCoordCount);
+	_normals.resize(header.normalCount);
+	_faces.resize(header.faceCount);
+	_lods.resize(header.lodCount);
+	if (vertexBytes > 0) { memcpy(_vertices.data(), p, vertexBytes); }
+	p += vertexBytes;
+	if (texCoordBytes > 0) { memcpy(_texCoords.data(), p, texCoordBytes); }
+	p += texCoordBytes;
+	if (normalBytes > 0) { memcpy(_normals.data(), p, normalBytes); }
+	p += normalBytes;
+	if (faceBytes > 0) { memcpy(_faces.data(), p, faceBytes); }
+	p += faceBytes;
+	memcpy(_lods.data(), p, lodBytes);
+	p += lodBytes;
+	// levels after the first follow each other in _lodFaces
+	size_t lodFaceCount = 0;
+	if (_lods[0].firstFace != 0 || _lods[0].faceCount != header.faceCount) { return false; }
+	for (size_t i = 1; i < _lods.size(); i++)
+	{
+		if (_lods[i].firstFace != lodFaceCount) { return false; }
+		lodFaceCount += _lods[i].faceCount;
+	}
+	if (size != sizeof(header) + arrayBytes + lodFaceCount * sizeof(Vec3d)) { return false; }
+	_lodFaces.resize(lodFaceCount);
+	if (lodFaceCount > 0) { memcpy(_lodFaces.data(), p, lodFaceCount * sizeof(Vec3d)); }
+	// the draw loop trusts every index, so a damaged cache must not get through
+	const std::vector<Vec3d>* lists[2] = { &_faces, &_lodFaces };
+	for (const std::vector<Vec3d>* list : lists)
+	{
+		for (const Vec3d& face : *list)
+		{
+			if ((unsigned)face.a >= header.vertexCount || (unsigned)face.b >= header.vertexCount || (unsigned)face.c >= header.vertexCount)
+			{
+				return false;
+			}
+		}
+	}
+	_minX = header.minX; _minY = header.minY; _minZ = header.minZ;
+	_maxX = header.maxX; _maxY = header.maxY; _maxZ = header.maxZ;
+	_origin = header.origin;
+	_offset = header.offset;
+	_boundingBox = header.boundingBox;
+	_maxBoundingBoxSide = header.maxBoundingBoxSide;
+	return true;
+}
+// writes to a temporary file first so a crash never leaves a half-written cache behind
+void ObjParser::WriteCache(const std::string& cacheName, uint64_t sourceSize, int64_t sourceTime, uint64_t sourceHash)
+{
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+	header.version = kCacheVersion;
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+	header.sourceHash = sourceHash;
+	header.vertexCount = (uint32_t)_vertices.size();
+	header.texCoordCount = (uint32_t)_texCoords.size();
+	header.normalCount = (uint32_t)_normals.size();
+	header.faceCount = (uint32_t)_faces.size();
+	header.minX = _minX; header.minY = _minY; header.minZ = _minZ;
+	header.maxX = _maxX; header.maxY = _maxY; header.maxZ = _maxZ;
+	header.origin = _origin;
+	header.offset = _offset;
+	header.boundingBox = _boundingBox;
+	header.maxBoundingBoxSide = _maxBoundingBoxSide;
+	header.creaseAngle = _creaseAngle;
+	header.lodCount = (uint32_t)_lods.size();
+
+	std::string tempName = cacheName + ".tmp";
+	{
+		std::ofstream out(tempName, std::ios::binary | std::ios::trunc);
+		if (!out) { return; }
+		out.write((const char*)&header, sizeof(header));
+		out.write((const char*)_vertices.data(), _vertices.size() * sizeof(Vec3f));
+		out.write((const char*)_texCoords.data(), _texCoords.size() * sizeof(Vec2f));
+		out.write((const char*)_normals.data(), _normals.size() * sizeof(Vec3f));
+		out.write((const char*)_faces.data(), _faces.size() * sizeof(Vec3d));
+		out.write((const char*)_lods.data(), _lods.size() * sizeof(MeshLod));
+		out.write((const char*)_lodFaces.data(), _lodFaces.size() * sizeof(Vec3d));
+		if (!out) { out.close(); std::remove(tempName.c_str()); return; }
+	}
+	std::remove(cacheName.c_str()); // rename does not replace on windows
+	if (std::rename(tempName.c_str(), cacheName.c_str()) != 0) { std::remove(tempName.c_str()); }
+}
+// splits the buffer at line boundaries and parses the pieces on the shared pool.
+// positive face indices are absolute in the file, so chunks only need to be placed;
+// negative ones are finished once every chunk's offset is known.
+// returns the number of triangles rejected for bad indices
+size_t ObjParser::ParseBuffer(const char* begin, const char* end)
+{
+	ThreadPool& pool = ThreadPool::Shared();
+	size_t size = (size_t)(end - begin);
+	size_t chunkSize = size / (pool.GetThreadCount() * 4);
+	chunkSize = chunkSize > kMinChunkSize ? chunkSize : kMinChunkSize;
+	std::vector<const char*> bounds;
+	bounds.push_back(begin);
+	for (const char* split = begin + chunkSize; split < end; split += chunkSize)
+	{
+		split = (const char*)memchr(split, '\n', (size_t)(end - split));
+		if (split == nullptr) { break; }
+		split++;
+		if (split < end) { bounds.push_back(split); }
+	}
+	bounds.push_back(end);
+
+	size_t chunkCount = bounds.size() - 1;
+	std::vector<ObjChunk> chunks(chunkCount);
+	if (chunkCount == 1)
+	{
+		// small files are not worth the hand-off
+		ParseRange(begin, end, chunks[0]);
+	}
+	else
+	{
+		std::vector<std::future<void>> pending;
+		for (size_t i = 0; i < chunkCount; i++)
+		{
+			const char* chunkBegin = bounds[i];
+			const char* chunkEnd = bounds[i + 1];
+			ObjChunk* chunk = &chunks[i];
+			pending.push_back(pool.Submit([chunkBegin, chunkEnd, chunk]() { ParseRange(chunkBegin, chunkEnd, *chunk); }));
+		}
+		for (std::future<void>& task : pending)
+		{
+			task.get();
+		}
+	}
+
+	ObjChunk all;
+	std::vector<size_t> positionOffsets = AppendChunks(all.positions, chunks, &ObjChunk::positions);
+	std::vector<size_t> texCoordOffsets = AppendChunks(all.texCoords, chunks, &ObjChunk::texCoords);
+	std::vector<size_t> normalOffsets = AppendChunks(all.normals, chunks, &ObjChunk::normals);
+	std::vector<size_t> cornerOffsets = AppendChunks(all.corners, chunks, &ObjChunk::corners);
+	for (size_t i = 0; i < chunkCount; i++)
+	{
+		for (size_t k = cornerOffsets[i]; k < cornerOffsets[i + 1]; k++)
+		{
+			ObjCorner& corner = all.corners[k];
+			if (corner.relative == 0) { continue; }
+			if (corner.relative & kRelativeV) { corner.v += (int)positionOffsets[i]; }
+			if (corner.relative & kRelativeT) { corner.t += (int)texCoordOffsets[i]; }
+			if (corner.relative & kRelativeN) { corner.n += (int)normalOffsets[i]; }
+		}
+	}
+	for (const ObjChunk& chunk : chunks)
+	{
+		// merge the bounding box
+		_minX = chunk.minX < _minX ? chunk.minX : _minX;
+		_minY = chunk.minY < _minY ? chunk.minY : _minY;
+		_minZ = chunk.minZ < _minZ ? chunk.minZ : _minZ;
+		_maxX = chunk.maxX > _maxX ? chunk.maxX : _maxX;
+		_maxY = chunk.maxY > _maxY ? chunk.maxY : _maxY;
+		_maxZ = chunk.maxZ > _maxZ ? chunk.maxZ : _maxZ;
+	}
+	chunks.clear();
+	size_t dropped = WeldCorners(all, _vertices, _texCoords, _normals, _faces);
+	if (_normals.empty() && !_faces.empty())
+	{
+		// without normals GL_LIGHTING shades the mesh with whatever normal was set last
+		GenerateNormals(_vertices, _texCoords, _normals, _faces, _creaseAngle);
+	}
+	return dropped;
+}
+void ObjParser::Draw(GLenum renderMode, bool isTex, int lod)
+{
+	int mode = renderMode == GL_POINTS ? 0 : renderMode == GL_LINES ? 1 : renderMode == GL_TRIANGLES ? 2 : -1;
+	if (_displayListSetting == kDisplayListsAuto)
+	{
+		// needs a current context, so decided on the first draw
+		_displayListSetting = GLEE_ARB_vertex_buffer_object ? kDisplayListsOff : kDisplayListsOn;
+	}
+	// lists only hold the full mesh, coarser levels are cheap enough to draw directly
+	if (_displayListSetting == kDisplayListsOn && mode >= 0 && lod == 0)
+	{
+		GLuint& list = _displayLists[mode][isTex ? 1 : 0];
+		if (list == 0)
+		{
+			// record the draw once, later calls replay it
+			list = glGenLists(1);
+			glNewList(list, GL_COMPILE);
+			DrawDirect(renderMode, isTex, 0);
+			glEndList();
+		}
+		glCallList(list);
+		return;
+	}
+	DrawDirect(renderMode, isTex, lod);
+}
+void ObjParser::DrawDirect(GLenum renderMode, bool isTex, int lod)
 {
 	switch (renderMode)
 	{
@@ -83,7 +1501,7 @@ void ObjParser::Draw(GLenum renderMode, bool isTex)
 		DrawLines(isTex);
 		break;
 	case GL_TRIANGLES:
-		DrawFaces(isTex);
+		DrawFaces(isTex, lod);
 		break;
 	default:
 		break;
@@ -134,43 +1552,268 @@ void ObjParser::DrawLines(bool isTex)
 	glEnd();
 	glLineWidth(1); // reset default value
 }
-void ObjParser::DrawFaces(bool isTex)
+void ObjParser::DrawFaces(bool isTex, int lod)
 {
-	Vec3f a, b, c;
-	GLint vertexIndexA, vertexIndexB, vertexIndexC;
-	glBegin(GL_TRIANGLES);
-	for (const Vec3d& face : _faces) 
+	DrawMesh(PrepareMesh(isTex), isTex, 0, lod);
+}
+// the mesh DrawFaces and DrawInstances submit, uploaded on first use
+const ObjParser::GpuMesh& ObjParser::PrepareMesh(bool isTex)
+{
+	if (isTex && _texCoords.empty())
 	{
-		vertexIndexA = face.a;
-		vertexIndexB = face.b;
-		vertexIndexC = face.c;
-
-		a.x = _vertices[vertexIndexA].x;
-		a.y = _vertices[vertexIndexA].y;
-		a.z = _vertices[vertexIndexA].z;
+		if (!_placeholderMesh.ready)
+		{
+			// objs without texture coordinates keep the old (0,0),(1,0),(0,1) mapping per triangle,
+			// which cannot share vertices between triangles. the lods follow the full mesh
+			const Vec2f placeholder[3] = { { 0, 0 }, { 1, 0 }, { 0, 1 } };
+			size_t cornerCount = (_faces.size() + _lodFaces.size()) * 3;
+			_placeholderVertices.reserve(cornerCount);
+			_placeholderTexCoords.reserve(cornerCount);
+			const std::vector<Vec3d>* lists[2] = { &_faces, &_lodFaces };
+			for (const std::vector<Vec3d>* list : lists)
+			{
+				for (const Vec3d& face : *list)
+				{
+					const int corners[3] = { face.a, face.b, face.c };
+					for (int i = 0; i < 3; i++)
+					{
+						_placeholderVertices.push_back(_vertices[corners[i]]);
+						_placeholderTexCoords.push_back(placeholder[i]);
+						if (!_normals.empty()) { _placeholderNormals.push_back(_normals[corners[i]]); }
+					}
+				}
+			}
+			UploadMesh(_placeholderMesh, _placeholderVertices, _placeholderTexCoords, _placeholderNormals, nullptr, nullptr);
+			_placeholderMesh.count = (GLsizei)_faces.size() * 3;
+			_placeholderMesh.hasLods = !_lodFaces.empty();
+			if (_placeholderMesh.vertexBuffer)
+			{
+				// only needed until they are in the buffer
+				std::vector<Vec3f>().swap(_placeholderVertices);
+				std::vector<Vec2f>().swap(_placeholderTexCoords);
+				std::vector<Vec3f>().swap(_placeholderNormals);
+			}
+		}
+		return _placeholderMesh;
+	}
+	if (!_mesh.ready) { UploadMesh(_mesh, _vertices, _texCoords, _normals, &_faces, &_lodFaces); }
+	return _mesh;
+}
+// puts the arrays into buffer objects when the driver has them and otherwise keeps pointing at them.
+// lodFaces go in the same index buffer, after faces
+void ObjParser::UploadMesh(GpuMesh& mesh, const std::vector<Vec3f>& vertices, const std::vector<Vec2f>& texCoords,
+	const std::vector<Vec3f>& normals, const std::vector<Vec3d>* faces, const std::vector<Vec3d>* lodFaces)
+{
+	size_t faceBytes = faces ? faces->size() * sizeof(Vec3d) : 0;
+	size_t lodFaceBytes = lodFaces ? lodFaces->size() * sizeof(Vec3d) : 0;
+	size_t positionBytes = vertices.size() * sizeof(Vec3f);
+	size_t texCoordBytes = texCoords.size() * sizeof(Vec2f);
+	size_t normalBytes = normals.size() * sizeof(Vec3f);
+	mesh.hasTexCoords = !texCoords.empty();
+	mesh.hasNormals = !normals.empty();
+	mesh.hasLods = faces && lodFaceBytes > 0;
+	mesh.count = faces ? (GLsizei)(faces->size() * 3) : (GLsizei)vertices.size();
+	mesh.vertexBuffer = mesh.indexBuffer = 0;
+	if (GLEE_ARB_vertex_buffer_object)
+	{
+		glGenBuffersARB(1, &mesh.vertexBuffer);
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, mesh.vertexBuffer);
+		glBufferDataARB(GL_ARRAY_BUFFER_ARB, positionBytes + texCoordBytes + normalBytes, NULL, GL_STATIC_DRAW_ARB);
+		glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, 0, positionBytes, vertices.data());
+		glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, positionBytes, texCoordBytes, texCoords.data());
+		glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, positionBytes + texCoordBytes, normalBytes, normals.data());
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+		mesh.positions = (const GLvoid*)0;
+		mesh.texCoords = (const GLvoid*)positionBytes;
+		mesh.normals = (const GLvoid*)(positionBytes + texCoordBytes);
+		mesh.indices = nullptr;
+		mesh.lodIndices = (const GLvoid*)faceBytes;
+		if (faces)
+		{
+			glGenBuffersARB(1, &mesh.indexBuffer);
+			glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, mesh.indexBuffer);
+			glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, faceBytes + lodFaceBytes, NULL, GL_STATIC_DRAW_ARB);
+			glBufferSubDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0, faceBytes, faces->data());
+			if (mesh.hasLods) { glBufferSubDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, faceBytes, lodFaceBytes, lodFaces->data()); }
+			glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+		}
+	}
+	else
+	{
+		mesh.positions = vertices.data();
+		mesh.texCoords = texCoords.data();
+		mesh.normals = normals.data();
+		mesh.indices = faces ? faces->data() : nullptr;
+		mesh.lodIndices = mesh.hasLods ? lodFaces->data() : nullptr;
+	}
+	mesh.ready = true;
+}
+// one draw call per mesh, the cost no longer grows with the triangle count on the CPU side.
+// instanceCount > 0 draws that many copies for the instancing shader
+void ObjParser::DrawMesh(const GpuMesh& mesh, bool isTex, GLsizei instanceCount, int lod)
+{
+	bool useTex = isTex && mesh.hasTexCoords;
+	bool indexed = mesh.indexBuffer || mesh.indices;
+	const GLvoid* indices = mesh.indices;
+	GLint first = 0;
+	GLsizei count = mesh.count;
+	if (lod > 0 && mesh.hasLods && lod < (int)_lods.size())
+	{
+		// after the full mesh's indices, or its unwelded triangles
+		if (indexed) { indices = (const char*)mesh.lodIndices + _lods[lod].firstFace * sizeof(Vec3d); }
+		else { first = (GLint)(_faces.size() + _lods[lod].firstFace) * 3; }
+		count = (GLsizei)_lods[lod].faceCount * 3;
+	}
+	if (mesh.vertexBuffer) { glBindBufferARB(GL_ARRAY_BUFFER_ARB, mesh.vertexBuffer); }
+	if (mesh.indexBuffer) { glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, mesh.indexBuffer); }
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, mesh.positions);
+	if (useTex)
+	{
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		glTexCoordPointer(2, GL_FLOAT, 0, mesh.texCoords);
+	}
+	if (mesh.hasNormals)
+	{
+		glEnableClientState(GL_NORMAL_ARRAY);
+		glNormalPointer(GL_FLOAT, 0, mesh.normals);
+	}
+	if (instanceCount > 0)
+	{
+		if (indexed) { glDrawElementsInstancedEXT(GL_TRIANGLES, count, GL_UNSIGNED_INT, indices, instanceCount); }
+		else { glDrawArraysInstancedEXT(GL_TRIANGLES, first, count, instanceCount); }
+	}
+	else if (indexed) { glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, indices); }
+	else { glDrawArrays(GL_TRIANGLES, first, count); }
+	if (mesh.hasNormals) { glDisableClientState(GL_NORMAL_ARRAY); }
+	if (useTex) { glDisableClientState(GL_TEXTURE_COORD_ARRAY); }
+	glDisableClientState(GL_VERTEX_ARRAY);
+	if (mesh.indexBuffer) { glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0); }
+	if (mesh.vertexBuffer) { glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0); }
+}
+// draws one copy of the mesh per column-major 4x4 matrix, each applied after the current modelview
+// like glMultMatrixf would be. uses a single instanced call when the driver can run the instancing
+// shader and one glDrawElements per matrix otherwise
+void ObjParser::DrawInstances(const GLfloat* matrices, GLsizei count, bool isTex, int lod)
+{
+	if (count <= 0) { return; }
+	const GpuMesh& mesh = PrepareMesh(isTex);
+	InstanceProgram& program = GetInstanceProgram();
+	if (!program.program)
+	{
+		for (GLsizei i = 0; i < count; i++)
+		{
+			glPushMatrix();
+			glMultMatrixf(matrices + i * 16);
+			Draw(GL_TRIANGLES, isTex, lod);
+			glPopMatrix();
+		}
+		return;
+	}
 
-		b.x = _vertices[vertexIndexB].x;
-		b.y = _vertices[vertexIndexB].y;
-		b.z = _vertices[vertexIndexB].z;
+	// four texels (the columns) per matrix, rows of kInstanceTextureWidth texels
+	GLsizei rows = (count * 4 + kInstanceTextureWidth - 1) / kInstanceTextureWidth;
+	GLint activeTexture;
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, program.matrixTexture);
+	if (rows > program.matrixRows)
+	{
+		program.matrixRows = rows;
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F_ARB, kInstanceTextureWidth, rows, 0, GL_RGBA, GL_FLOAT, NULL);
+	}
+	GLsizei fullRows = count * 4 / kInstanceTextureWidth;
+	if (fullRows > 0) { glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, kInstanceTextureWidth, fullRows, GL_RGBA, GL_FLOAT, matrices); }
+	if (fullRows < rows)
+	{
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, fullRows, count * 4 - fullRows * kInstanceTextureWidth, 1, GL_RGBA, GL_FLOAT,
+			matrices + fullRows * kInstanceTextureWidth * 4);
+	}
+	glActiveTexture(activeTexture);
 
-		c.x = _vertices[vertexIndexC].x;
-		c.y = _vertices[vertexIndexC].y;
-		c.z = _vertices[vertexIndexC].z;
+	// follow whatever fixed-function state the caller set for this pass
+	glUseProgram(program.program);
+	glUniform1i(program.lightingLocation, glIsEnabled(GL_LIGHTING));
+	glUniform1i(program.texturingLocation, isTex && glIsEnabled(GL_TEXTURE_2D));
+	DrawMesh(mesh, isTex, count, lod);
+	glUseProgram(0);
+}
+// built once per process on the GL thread, program stays 0 when instancing is not available
+ObjParser::InstanceProgram& ObjParser::GetInstanceProgram()
+{
+	static InstanceProgram program = { 0, 0, 0, 0, 0 };
+	static bool checked = false;
+	if (checked) { return program; }
+	checked = true;
+	if (!GLEE_VERSION_2_0 || !GLEE_EXT_draw_instanced || !GLEE_EXT_gpu_shader4 || !GLEE_ARB_texture_float || !GLEE_ARB_vertex_buffer_object)
+	{
+		std::cout << "instanced drawing not supported, drawing instances one by one" << std::endl;
+		return program;
+	}
+	GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, kInstanceVertexShader);
+	GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, kInstanceFragmentShader);
+	GLint linked = GL_FALSE;
+	if (vertexShader && fragmentShader)
+	{
+		program.program = glCreateProgram();
+		glAttachShader(program.program, vertexShader);
+		glAttachShader(program.program, fragmentShader);
+		glLinkProgram(program.program);
+		glGetProgramiv(program.program, GL_LINK_STATUS, &linked);
+	}
+	if (vertexShader) { glDeleteShader(vertexShader); }
+	if (fragmentShader) { glDeleteShader(fragmentShader); }
+	if (!linked)
+	{
+		if (program.program) { glDeleteProgram(program.program); }
+		program.program = 0;
+		std::cout << "instancing shader failed to link, drawing instances one by one" << std::endl;
+		return program;
+	}
+	program.lightingLocation = glGetUniformLocation(program.program, "lighting");
+	program.texturingLocation = glGetUniformLocation(program.program, "texturing");
+	glUseProgram(program.program);
+	glUniform1i(glGetUniformLocation(program.program, "colorMap"), 0);
+	glUniform1i(glGetUniformLocation(program.program, "instanceMatrices"), 1);
+	glUseProgram(0);
 
-		if (isTex)
-		{
-			glTexCoord2f(0, 0); glVertex3f(a.x, a.y, a.z);
-			glTexCoord2f(1, 0); glVertex3f(b.x, b.y, b.z);
-			glTexCoord2f(0, 1); glVertex3f(c.x, c.y, c.z);
-		}
-		else
+	GLint activeTexture;
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+	glActiveTexture(GL_TEXTURE1);
+	glGenTextures(1, &program.matrixTexture);
+	glBindTexture(GL_TEXTURE_2D, program.matrixTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glActiveTexture(activeTexture);
+	return program;
+}
+// true records every draw mode into a display list on first use, false draws directly.
+// without a call, display lists are used only when the driver has no buffer objects
+void ObjParser::SetDisplayListCache(bool enabled)
+{
+	if ((_displayListSetting == kDisplayListsOn) != enabled) { ReleaseMeshes(); }
+	_displayListSetting = enabled ? kDisplayListsOn : kDisplayListsOff;
+}
+void ObjParser::ReleaseMeshes()
+{
+	GpuMesh* meshes[2] = { &_mesh, &_placeholderMesh };
+	for (GpuMesh* mesh : meshes)
+	{
+		if (mesh->ready && mesh->vertexBuffer) { glDeleteBuffersARB(1, &mesh->vertexBuffer); }
+		if (mesh->ready && mesh->indexBuffer) { glDeleteBuffersARB(1, &mesh->indexBuffer); }
+		mesh->ready = false;
+	}
+	for (int mode = 0; mode < 3; mode++)
+	{
+		for (int tex = 0; tex < 2; tex++)
 		{
-			glVertex3f(a.x, a.y, a.z);
-			glVertex3f(b.x, b.y, b.z);
-			glVertex3f(c.x, c.y, c.z);
+			if (_displayLists[mode][tex]) { glDeleteLists(_displayLists[mode][tex], 1); }
+			_displayLists[mode][tex] = 0;
 		}
 	}
-	glEnd();
+	_placeholderVertices.clear();
+	_placeholderTexCoords.clear();
+	_placeholderNormals.clear();
 }
 Vec3f ObjParser::GetOrigin()
 {
@@ -183,4 +1826,12 @@ Vec3f ObjParser::GetOffset()
 float ObjParser::GetMaxBoundingBoxSide()
 {
 	return _maxBoundingBoxSide;
+}
+void ObjParser::GetBoundingSphere(Vec3f& center, float& radius)
+{
+	// the box is centered on -_offset and _boundingBox holds its half extents
+	center.x = -_offset.x;
+	center.y = -_offset.y;
+	center.z = -_offset.z;
+	radius = std::sqrt(_boundingBox.x * _boundingBox.x + _boundingBox.y * _boundingBox.y + _boundingBox.z * _boundingBox.z);
 }
\ No newline at end of file
@@ -1,13 +1,26 @@
 #pragma once
 #include <vector>
+#include <string>
+#include <cstdint>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+// extension loader, must come before any gl header
+#include "glee.h"
 /*** freeglut***/
+#ifdef __linux__
+#include <GL/freeglut.h>
+#else
 #include <freeglut.h>
+#endif
 // gltools
 //#include "gltools.h"
 //#include "math3d.h"
+struct Vec2f
+{
+	float x;
+	float y;
+};
 struct Vec3f
 {
 	float x;
@@ -20,6 +33,14 @@ struct Vec3d
 	int b;
 	int c;
 };
+// one level of detail: faceCount triangles from firstFace on, and how far (in model units)
+// its surface may stray from the full mesh's
+struct MeshLod
+{
+	uint32_t firstFace;
+	uint32_t faceCount;
+	float error;
+};
 class ObjParser
 {
 private:
@@ -33,17 +54,80 @@ private:
 	Vec3f _boundingBox;
 	float _maxBoundingBoxSide;
 	float _pointSize, _lineWidth;
+	// objs without normals get smooth ones, split where faces meet at more than this many degrees
+	float _creaseAngle;
 	std::vector<Vec3f> _vertices;
+	// per vertex like _vertices, empty when the obj has none
+	std::vector<Vec2f> _texCoords;
+	std::vector<Vec3f> _normals;
 	std::vector<Vec3d> _faces;
+	// simplified copies of _faces sharing its vertices: _lods[0] is _faces itself, the
+	// coarser levels are ranges of _lodFaces
+	std::vector<Vec3d> _lodFaces;
+	std::vector<MeshLod> _lods;
+	// geometry kept in GL for DrawFaces, uploaded on the first draw since loading may happen
+	// off the GL thread. pointers are buffer offsets when vertexBuffer is set, client memory otherwise
+	struct GpuMesh
+	{
+		GLuint vertexBuffer; // positions, then texcoords, then normals
+		GLuint indexBuffer;
+		const GLvoid* positions;
+		const GLvoid* texCoords;
+		const GLvoid* normals;
+		const GLvoid* indices; // null draws the vertices in order
+		const GLvoid* lodIndices; // where _lodFaces start, when hasLods
+		GLsizei count;
+		bool hasTexCoords, hasNormals, hasLods;
+		bool ready;
+	};
+	GpuMesh _mesh;
+	// unwelded copy carrying the per-triangle placeholder texcoords for objs that have none
+	GpuMesh _placeholderMesh;
+	std::vector<Vec3f> _placeholderVertices;
+	std::vector<Vec2f> _placeholderTexCoords;
+	std::vector<Vec3f> _placeholderNormals;
+	// compiled Draw calls by render mode (points, lines, triangles) and isTex, 0 until first used
+	GLuint _displayLists[3][2];
+	enum { kDisplayListsAuto, kDisplayListsOn, kDisplayListsOff } _displayListSetting;
+	// shader and matrix texture shared by every DrawInstances call
+	struct InstanceProgram
+	{
+		GLuint program;
+		GLuint matrixTexture;
+		GLsizei matrixRows;
+		GLint lightingLocation, texturingLocation;
+	};
+	static InstanceProgram& GetInstanceProgram();
+	size_t ParseBuffer(const char* begin, const char* end);
+	bool ReadCache(const char* data, size_t size);
+	void WriteCache(const std::string& cacheName, uint64_t sourceSize, int64_t sourceTime, uint64_t sourceHash);
+	void DrawDirect(GLenum renderMode, bool isTex, int lod);
 	void DrawPoints(bool isTex);
 	void DrawLines(bool isTex);
-	void DrawFaces(bool isTex);
+	void DrawFaces(bool isTex, int lod);
+	void UploadMesh(GpuMesh& mesh, const std::vector<Vec3f>& vertices, const std::vector<Vec2f>& texCoords,
+		const std::vector<Vec3f>& normals, const std::vector<Vec3d>* faces, const std::vector<Vec3d>* lodFaces);
+	const GpuMesh& PrepareMesh(bool isTex);
+	void DrawMesh(const GpuMesh& mesh, bool isTex, GLsizei instanceCount, int lod);
+	void ReleaseMeshes();
+	ObjParser(const ObjParser&) = delete;
+	ObjParser& operator=(const ObjParser&) = delete;
 public:
+	// keeps the hard edges of boxy models while smoothing curved ones; 180 smooths everything
+	static constexpr float kDefaultCreaseAngle = 60.0f;
 	ObjParser(std::string filename);
-	ObjParser(std::string filename, float pointSize, float lineWidth);
+	ObjParser(std::string filename, float pointSize, float lineWidth, float creaseAngle = kDefaultCreaseAngle);
+	~ObjParser();
 	void LoadFile(std::string filename);
-	void Draw(GLenum renderMode, bool isTex);
+	// lod picks the level GL_TRIANGLES draws, 0 (the full mesh) to GetLodCount() - 1
+	void Draw(GLenum renderMode, bool isTex, int lod = 0);
+	void DrawInstances(const GLfloat* matrices, GLsizei count, bool isTex, int lod = 0);
+	void SetDisplayListCache(bool enabled);
 	Vec3f GetOrigin();
 	Vec3f GetOffset();
 	float GetMaxBoundingBoxSide();
+	// sphere around the bounding box, in the model's own coordinates
+	void GetBoundingSphere(Vec3f& center, float& radius);
+	int GetLodCount() const { return (int)_lods.size(); }
+	const MeshLod& GetLod(int lod) const { return _lods[lod]; }
 };
\ No newline at end of file
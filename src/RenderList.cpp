@@ -0,0 +1,295 @@
+#include "RenderList.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const GLfloat kBlack[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	const GLfloat kWhite[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	// view depths beyond this all share the last depth bucket (the far plane of ReshapeFunc)
+	const float kMaxSortDepth = 50.0f;
+	// how far on screen a lod may move the surface before a finer one is drawn instead
+	const float kLodPixelError = 1.0f;
+
+	// 64 bit key, most significant first:
+	// pass 4 | material 8 | shader 4 | texture 16 | mesh 8 | depth 24
+	// pass is 0 for everything the scene has today (opaque)
+	uint64_t MakeSortKey(unsigned pass, unsigned material, unsigned shader, unsigned texture, unsigned mesh, unsigned depth)
+	{
+		return ((uint64_t)(pass & 0xf) << 60) | ((uint64_t)(material & 0xff) << 52) | ((uint64_t)(shader & 0xf) << 48) |
+			((uint64_t)(texture & 0xffff) << 32) | ((uint64_t)(mesh & 0xff) << 24) | (depth & 0xffffff);
+	}
+	// world bounding sphere of a mesh drawn with column-major matrix m, and the largest
+	// axis scale of m
+	void InstanceSphere(const GLfloat* m, const Vec3f& center, float radius, float sphere[4], float& scale)
+	{
+		sphere[0] = m[0] * center.x + m[4] * center.y + m[8] * center.z + m[12];
+		sphere[1] = m[1] * center.x + m[5] * center.y + m[9] * center.z + m[13];
+		sphere[2] = m[2] * center.x + m[6] * center.y + m[10] * center.z + m[14];
+		scale = std::sqrt(std::max(m[0] * m[0] + m[1] * m[1] + m[2] * m[2],
+			std::max(m[4] * m[4] + m[5] * m[5] + m[6] * m[6], m[8] * m[8] + m[9] * m[9] + m[10] * m[10])));
+		sphere[3] = radius * scale;
+	}
+	void ApplyMaterial(DrawMaterial material)
+	{
+		if (material == kMaterialMatte)
+		{
+			glColorMaterial(GL_FRONT, GL_SPECULAR);
+			glMaterialfv(GL_FRONT, GL_SPECULAR, kBlack);
+		}
+		else
+		{
+			glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
+			glMaterialfv(GL_FRONT, GL_SPECULAR, kWhite);
+		}
+	}
+}
+
+RenderList::RenderList()
+{
+	Clear();
+}
+void RenderList::Clear()
+{
+	_items.clear();
+	_matrices.clear();
+	_order.clear();
+	_stats.requested = 0;
+	_stats.issued = 0;
+	_stats.drawnInstances = 0;
+	_stats.culledInstances = 0;
+	_stats.triangles = 0;
+	_stats.fullTriangles = 0;
+}
+GLfloat* RenderList::Add(ObjParser* mesh, GLuint texture, bool textured, const GLfloat color[4], DrawMaterial material, GLsizei count)
+{
+	DrawItem item;
+	item.mesh = mesh;
+	item.texture = textured ? texture : 0;
+	item.textured = textured;
+	for (int i = 0; i < 4; i++) { item.color[i] = color[i]; }
+	item.material = material;
+	item.firstMatrix = _matrices.size() / 16;
+	item.instanceCount = count;
+	item.lod = 0;
+	item.sortKey = 0;
+	_order.push_back(_items.size());
+	_items.push_back(item);
+	_matrices.resize(_matrices.size() + (size_t)count * 16);
+	return _matrices.data() + item.firstMatrix * 16;
+}
+void RenderList::Cull(const Frustum& frustum, const GLfloat shadowPlane[4], const GLfloat light[4])
+{
+	size_t total = _matrices.size() / 16;
+	_sphereX.resize(total * 2);
+	_sphereY.resize(total * 2);
+	_sphereZ.resize(total * 2);
+	_sphereRadius.resize(total * 2);
+	_visible.resize(total * 2);
+
+	for (const DrawItem& item : _items)
+	{
+		Vec3f center;
+		float radius;
+		item.mesh->GetBoundingSphere(center, radius);
+		for (GLsizei i = 0; i < item.instanceCount; i++)
+		{
+			size_t k = item.firstMatrix + i;
+			float sphere[4], shadow[4], scale;
+			InstanceSphere(&_matrices[k * 16], center, radius, sphere, scale);
+			_sphereX[k] = sphere[0];
+			_sphereY[k] = sphere[1];
+			_sphereZ[k] = sphere[2];
+			_sphereRadius[k] = sphere[3];
+
+			// shadows that cannot be bounded always count as visible
+			size_t s = total + k;
+			if (!GetShadowSphere(shadowPlane, light, sphere, shadow))
+			{
+				shadow[0] = sphere[0];
+				shadow[1] = sphere[1];
+				shadow[2] = sphere[2];
+				shadow[3] = kUnboundedRadius;
+			}
+			_sphereX[s] = shadow[0];
+			_sphereY[s] = shadow[1];
+			_sphereZ[s] = shadow[2];
+			_sphereRadius[s] = shadow[3];
+		}
+	}
+	frustum.TestSpheres(_sphereX.data(), _sphereY.data(), _sphereZ.data(), _sphereRadius.data(), total * 2, _visible.data());
+
+	// compact each item's matrices in place, keeping their order
+	for (DrawItem& item : _items)
+	{
+		GLsizei kept = 0;
+		for (GLsizei i = 0; i < item.instanceCount; i++)
+		{
+			size_t k = item.firstMatrix + i;
+			if (!_visible[k] && !_visible[total + k]) { continue; }
+			if (kept != i) { std::copy(&_matrices[k * 16], &_matrices[k * 16] + 16, &_matrices[(item.firstMatrix + kept) * 16]); }
+			kept++;
+		}
+		_stats.drawnInstances += kept;
+		_stats.culledInstances += item.instanceCount - kept;
+		item.instanceCount = kept;
+	}
+}
+void RenderList::SelectLods(const GLfloat eye[3], float pixelsPerUnit)
+{
+	// items added here already have their lod
+	size_t itemCount = _items.size();
+	for (size_t index = 0; index < itemCount; index++)
+	{
+		ObjParser* mesh = _items[index].mesh;
+		int lodCount = mesh->GetLodCount();
+		GLsizei count = _items[index].instanceCount;
+		if (lodCount < 2 || count == 0) { continue; }
+		Vec3f center;
+		float radius;
+		mesh->GetBoundingSphere(center, radius);
+		GLfloat* matrices = &_matrices[_items[index].firstMatrix * 16];
+
+		// the error is scaled by the instance, then shrinks with distance to the sphere's near side
+		_lodOf.resize(count);
+		_lodStarts.assign(lodCount + 1, 0);
+		for (GLsizei i = 0; i < count; i++)
+		{
+			float sphere[4], scale;
+			InstanceSphere(matrices + i * 16, center, radius, sphere, scale);
+			float dx = sphere[0] - eye[0], dy = sphere[1] - eye[1], dz = sphere[2] - eye[2];
+			float distance = std::sqrt(dx * dx + dy * dy + dz * dz) - sphere[3];
+			int lod = lodCount - 1;
+			while (lod > 0 && (distance <= 0.0f || mesh->GetLod(lod).error * scale * pixelsPerUnit > kLodPixelError * distance)) { lod--; }
+			_lodOf[i] = lod;
+			_lodStarts[lod + 1]++;
+		}
+		for (int lod = 0; lod < lodCount; lod++) { _lodStarts[lod + 1] += _lodStarts[lod]; }
+
+		// group the matrices by lod, each group keeping its order, and give every group but the
+		// first its own item. placing advances each start to the end of its group
+		_lodMatrices.resize((size_t)count * 16);
+		for (GLsizei i = 0; i < count; i++)
+		{
+			std::copy(matrices + i * 16, matrices + i * 16 + 16, &_lodMatrices[(size_t)_lodStarts[_lodOf[i]]++ * 16]);
+		}
+		std::copy(_lodMatrices.begin(), _lodMatrices.end(), matrices);
+		bool first = true;
+		for (int lod = 0; lod < lodCount; lod++)
+		{
+			GLsizei start = lod > 0 ? _lodStarts[lod - 1] : 0;
+			if (_lodStarts[lod] == start) { continue; }
+			DrawItem item = _items[index];
+			item.firstMatrix += start;
+			item.instanceCount = _lodStarts[lod] - start;
+			item.lod = lod;
+			if (first) { _items[index] = item; }
+			else
+			{
+				_order.push_back(_items.size());
+				_items.push_back(item);
+			}
+			first = false;
+		}
+	}
+}
+void RenderList::Sort(const GLfloat eye[3], const GLfloat forward[3])
+{
+	std::vector<ObjParser*> meshes;
+	for (DrawItem& item : _items)
+	{
+		// nearest instance decides where the whole item goes
+		float nearest = kMaxSortDepth;
+		for (GLsizei i = 0; i < item.instanceCount; i++)
+		{
+			const GLfloat* matrix = &_matrices[(item.firstMatrix + i) * 16];
+			float depth = (matrix[12] - eye[0]) * forward[0] + (matrix[13] - eye[1]) * forward[1] + (matrix[14] - eye[2]) * forward[2];
+			nearest = std::min(nearest, depth);
+		}
+		nearest = std::max(nearest, 0.0f);
+		unsigned depth = (unsigned)(nearest / kMaxSortDepth * 0xffffff);
+
+		size_t mesh = std::find(meshes.begin(), meshes.end(), item.mesh) - meshes.begin();
+		if (mesh == meshes.size()) { meshes.push_back(item.mesh); }
+
+		item.sortKey = MakeSortKey(0, item.material, item.instanceCount > 1 ? 1 : 0, item.texture, (unsigned)mesh, depth);
+	}
+	std::stable_sort(_order.begin(), _order.end(), [this](size_t a, size_t b) { return _items[a].sortKey < _items[b].sortKey; });
+}
+void RenderList::Draw(bool shadowPass) const
+{
+	DrawMaterial material = kMaterialDefault;
+	GLuint texture = 0; // 0 is texturing disabled
+	bool textureKnown = false;
+	GLfloat color[4];
+	bool colorKnown = false;
+
+	for (size_t index : _order)
+	{
+		const DrawItem& item = _items[index];
+		if (item.instanceCount == 0) { continue; }
+		if (!shadowPass)
+		{
+			_stats.requested += 3;
+			if (item.material != material)
+			{
+				ApplyMaterial(item.material);
+				material = item.material;
+				colorKnown = false; // switching what the color tracks
+				_stats.issued++;
+			}
+			if (!colorKnown || !std::equal(color, color + 4, item.color))
+			{
+				glColor4fv(item.color);
+				std::copy(item.color, item.color + 4, color);
+				colorKnown = true;
+				_stats.issued++;
+			}
+			if (!textureKnown || item.texture != texture)
+			{
+				if (item.textured)
+				{
+					if (textureKnown && texture == 0) { glEnable(GL_TEXTURE_2D); }
+					glBindTexture(GL_TEXTURE_2D, item.texture);
+				}
+				else
+				{
+					glDisable(GL_TEXTURE_2D);
+				}
+				texture = item.texture;
+				textureKnown = true;
+				_stats.issued++;
+			}
+		}
+
+		if (item.mesh->GetLodCount() > 0)
+		{
+			_stats.triangles += item.mesh->GetLod(item.lod).faceCount * item.instanceCount;
+			_stats.fullTriangles += item.mesh->GetLod(0).faceCount * item.instanceCount;
+		}
+		const GLfloat* matrices = &_matrices[item.firstMatrix * 16];
+		if (item.instanceCount > 1)
+		{
+			item.mesh->DrawInstances(matrices, item.instanceCount, item.textured, item.lod);
+		}
+		else if (item.instanceCount == 1)
+		{
+			glPushMatrix();
+			glMultMatrixf(matrices);
+			item.mesh->Draw(GL_TRIANGLES, item.textured, item.lod);
+			glPopMatrix();
+		}
+	}
+
+	// hand back the state the pass started with
+	if (material != kMaterialDefault)
+	{
+		ApplyMaterial(kMaterialDefault);
+		_stats.issued++;
+	}
+	if (textureKnown && texture == 0)
+	{
+		glEnable(GL_TEXTURE_2D);
+		_stats.issued++;
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "ObjParser.h"
+#include "Frustum.h"
+// fixed-function material setups an item can ask for
+enum DrawMaterial
+{
+	kMaterialDefault, // color tracks ambient and diffuse, white specular (as set up by SetupRC)
+	kMaterialMatte, // color tracks specular, so the highlight takes the item color; ambient and diffuse keep their last values
+};
+// one mesh drawn at one or more world transforms with the same texture and material
+struct DrawItem
+{
+	ObjParser* mesh;
+	GLuint texture;
+	bool textured; // untextured items are drawn with texturing disabled
+	GLfloat color[4];
+	DrawMaterial material;
+	size_t firstMatrix; // index of the first 4x4 matrix in the list's matrix array
+	GLsizei instanceCount;
+	int lod; // level of detail of the mesh every instance draws
+	uint64_t sortKey;
+};
+// counters since the last Clear. requested is the state changes drawing every item
+// with its full state would take, issued what was left after filtering; drawn and
+// culled count instances kept and dropped by Cull. triangles is what every pass
+// submitted, fullTriangles what it would have been with each instance at lod 0
+struct RenderStats
+{
+	unsigned requested;
+	unsigned issued;
+	unsigned drawnInstances;
+	unsigned culledInstances;
+	unsigned triangles;
+	unsigned fullTriangles;
+};
+// flat list of what a frame draws, built once from the scene and then replayed by
+// every pass (planar shadow and lit), so transforms are only computed once a frame.
+// items are drawn in sort key order, skipping state that is already current
+class RenderList
+{
+private:
+	std::vector<DrawItem> _items;
+	std::vector<GLfloat> _matrices;
+	std::vector<size_t> _order;
+	mutable RenderStats _stats;
+	// scratch for Cull: instance spheres followed by their shadow spheres
+	std::vector<float> _sphereX, _sphereY, _sphereZ, _sphereRadius;
+	std::vector<unsigned char> _visible;
+	// scratch for SelectLods
+	std::vector<int> _lodOf;
+	std::vector<GLsizei> _lodStarts;
+	std::vector<GLfloat> _lodMatrices;
+public:
+	RenderList();
+	void Clear();
+	// counts instances the caller dropped before adding them as culled
+	void CountCulled(unsigned instances) { _stats.culledInstances += instances; }
+	// adds an item with room for count column-major world matrices and returns the
+	// first one for the caller to fill; the pointer is valid until the next Add.
+	// items with no instances are skipped when drawing
+	GLfloat* Add(ObjParser* mesh, GLuint texture, bool textured, const GLfloat color[4], DrawMaterial material, GLsizei count);
+	// drops the instances that neither show in the frustum nor cast a visible shadow
+	// onto shadowPlane from the point light; call after every matrix is filled in
+	void Cull(const Frustum& frustum, const GLfloat shadowPlane[4], const GLfloat light[4]);
+	// gives each instance the coarsest lod of its mesh whose error, seen from eye, covers at
+	// most a pixel, splitting items into one per lod used. pixelsPerUnit is how many pixels
+	// a length of 1 spans at distance 1 straight ahead; call after Cull
+	void SelectLods(const GLfloat eye[3], float pixelsPerUnit);
+	// orders the items by material, shader (instanced or not), texture, mesh and then
+	// front to back from the eye; call after every matrix is filled in
+	void Sort(const GLfloat eye[3], const GLfloat forward[3]);
+	// shadow passes draw geometry only, in whatever color and state the caller set;
+	// lit passes also apply each item's texture, color and material, and expect and
+	// leave the default material with texturing enabled
+	void Draw(bool shadowPass) const;
+	const std::vector<DrawItem>& GetItems() const { return _items; }
+	const RenderStats& GetStats() const { return _stats; }
+};
@@ -0,0 +1,72 @@
+#include "SceneState.h"
+#include <algorithm>
+
+SceneState::SceneState(uint32_t seed)
+{
+	Reset(seed);
+}
+void SceneState::Reset(uint32_t seed)
+{
+	yRot = 0.0f;
+	cosWave = 0;
+	factor = 1;
+	counter = 0;
+	dx = dy = dz = 0.0f;
+	dRot = 0.0f;
+	stop = false;
+	moveCounter = 0;
+	ticks = 0;
+	_rng.seed(seed);
+	_accumulator = 0.0;
+}
+int SceneState::Update(double dt)
+{
+	int steps = 0;
+	_accumulator += std::min(std::max(dt, 0.0), kMaxCatchUp);
+	while (_accumulator >= kTimeStep)
+	{
+		_accumulator -= kTimeStep;
+		Step();
+		steps++;
+	}
+	return steps;
+}
+void SceneState::Step()
+{
+	ticks++;
+	yRot += 0.5f;
+	if (stop) { dRot += 0.5f; }
+
+	if (counter++ >= 5)
+	{
+		// reset counter
+		counter = 0;
+		// update swim counter
+		moveCounter++;
+		// update fishes cos-wave
+		factor = (cosWave >= 10 || cosWave <= -10) ? -factor : factor;
+		cosWave += factor;
+		cosWave = std::min(10, std::max(-10, cosWave));
+	}
+
+	if (moveCounter >= 20)
+	{
+		// reset swim counter
+		moveCounter = 0;
+		// check if dolphin need to stop
+		if (stop == true && dRot >= 180) { stop = false; } // unfreeze dolphin after stopped for a round
+		else if (stop == false) { stop = (Random(2) == 1); }
+
+		if (!stop)
+		{
+			dRot = 0.0f; // reset dRot for next time
+			float threshold = 20.0f;
+			dx += ((float)Random(3) - 1.0f) * 2; // 0, 1, 2 --> -1, 0, 1
+			dy += ((float)Random(3) - 1.0f) * 2;
+			dz += ((float)Random(3) - 1.0f) * 2;
+			dx = std::min(threshold, std::max(-threshold, dx));
+			dy = std::min(threshold, std::max(-threshold, dy));
+			dz = std::min(threshold, std::max(-threshold, dz));
+		}
+	}
+}
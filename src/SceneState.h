@@ -0,0 +1,38 @@
+#pragma once
+#include <random>
+#include <cstdint>
+// animation state of the ocean scene, advanced in fixed ticks independent of the
+// frame rate and of GL. drawing code only reads it, so the shadow and lit passes
+// of a frame always see the same state
+struct SceneState
+{
+	// one tick is one frame of the original frame-locked animation
+	static constexpr double kTimeStep = 1.0 / 60.0;
+	// longest real time caught up in one Update, so a stall does not replay seconds of ticks
+	static constexpr double kMaxCatchUp = 0.25;
+
+	float yRot; // rotation angle of the barrels, fishes and dolphin swim
+	int cosWave; // fish bobbing, -10..10, bounces between the ends
+	int factor;
+	int counter; // ticks since the last fish step
+	// dolphin walk
+	float dx, dy, dz;
+	float dRot; // rotation made up while the dolphin is stopped
+	bool stop;
+	int moveCounter; // fish steps since the last dolphin step
+	uint64_t ticks;
+
+	SceneState(uint32_t seed = 1);
+	// restarts the animation and the random sequence
+	void Reset(uint32_t seed);
+	// runs every whole tick contained in the elapsed time (plus the remainder kept
+	// from earlier calls) and returns how many ran
+	int Update(double dt);
+	void Step();
+	// uniform in [0, n), same sequence for a given seed on every platform
+	int Random(int n) { return (int)(_rng() % (uint32_t)n); }
+	float GetCosWave() const { return cosWave / 10.0f; }
+private:
+	std::mt19937 _rng;
+	double _accumulator;
+};
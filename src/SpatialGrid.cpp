@@ -0,0 +1,298 @@
+#include "SpatialGrid.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	const int kUnboundedCell = -2;
+
+	uint64_t MakeCellKey(int column, int row)
+	{
+		return ((uint64_t)(uint32_t)column << 32) | (uint32_t)row;
+	}
+	// distance along a normalized ray to the first point of the sphere, or -1 on a miss
+	float IntersectSphere(const float* origin, const float* direction, float x, float y, float z, float radius)
+	{
+		float ox = origin[0] - x, oy = origin[1] - y, oz = origin[2] - z;
+		float b = ox * direction[0] + oy * direction[1] + oz * direction[2];
+		float c = ox * ox + oy * oy + oz * oz - radius * radius;
+		if (c > 0.0f && b > 0.0f) { return -1.0f; } // outside and pointing away
+		float discriminant = b * b - c;
+		if (discriminant < 0.0f) { return -1.0f; }
+		return std::max(0.0f, -b - sqrtf(discriminant));
+	}
+}
+
+SpatialGrid::SpatialGrid(float cellSize)
+{
+	_cellSize = cellSize;
+	_maxRadius = 0.0f;
+	_count = 0;
+	_stamp = 0;
+}
+int SpatialGrid::GetCellCoord(float v) const
+{
+	return (int)std::floor(v / _cellSize);
+}
+const SpatialGrid::Cell* SpatialGrid::FindCell(int column, int row) const
+{
+	std::unordered_map<uint64_t, int>::const_iterator found = _cellIndex.find(MakeCellKey(column, row));
+	if (found == _cellIndex.end()) { return nullptr; }
+	const Cell& cell = _cells[found->second];
+	return cell.ids.empty() ? nullptr : &cell;
+}
+void SpatialGrid::Link(int id)
+{
+	Entry& entry = _entries[id];
+	if (entry.radius >= kUnboundedRadius)
+	{
+		entry.cell = kUnboundedCell;
+		entry.slot = (int)_unbounded.size();
+		_unbounded.push_back(id);
+		return;
+	}
+	uint64_t key = MakeCellKey(GetCellCoord(entry.x), GetCellCoord(entry.z));
+	std::unordered_map<uint64_t, int>::iterator found = _cellIndex.find(key);
+	if (found == _cellIndex.end())
+	{
+		found = _cellIndex.insert(std::make_pair(key, (int)_cells.size())).first;
+		_cells.push_back(Cell());
+	}
+	Cell& cell = _cells[found->second];
+	float sphereMin[3] = { entry.x - entry.radius, entry.y - entry.radius, entry.z - entry.radius };
+	float sphereMax[3] = { entry.x + entry.radius, entry.y + entry.radius, entry.z + entry.radius };
+	for (int i = 0; i < 3; i++)
+	{
+		cell.boxMin[i] = cell.ids.empty() ? sphereMin[i] : std::min(cell.boxMin[i], sphereMin[i]);
+		cell.boxMax[i] = cell.ids.empty() ? sphereMax[i] : std::max(cell.boxMax[i], sphereMax[i]);
+	}
+	entry.cell = found->second;
+	entry.slot = (int)cell.ids.size();
+	cell.ids.push_back(id);
+}
+void SpatialGrid::Unlink(int id)
+{
+	Entry& entry = _entries[id];
+	std::vector<int>& ids = entry.cell == kUnboundedCell ? _unbounded : _cells[entry.cell].ids;
+	// swap the last id into the hole
+	int moved = ids.back();
+	ids[entry.slot] = moved;
+	_entries[moved].slot = entry.slot;
+	ids.pop_back();
+	entry.cell = -1;
+}
+int SpatialGrid::Insert(float x, float y, float z, float radius)
+{
+	int id;
+	if (!_freeIds.empty())
+	{
+		id = _freeIds.back();
+		_freeIds.pop_back();
+	}
+	else
+	{
+		id = (int)_entries.size();
+		_entries.push_back(Entry());
+	}
+	Entry& entry = _entries[id];
+	entry.x = x;
+	entry.y = y;
+	entry.z = z;
+	entry.radius = radius;
+	if (radius < kUnboundedRadius) { _maxRadius = std::max(_maxRadius, radius); }
+	Link(id);
+	_count++;
+	return id;
+}
+void SpatialGrid::Update(int id, float x, float y, float z, float radius)
+{
+	Entry& entry = _entries[id];
+	bool unbounded = radius >= kUnboundedRadius;
+	bool sameCell = entry.cell == kUnboundedCell ? unbounded :
+		!unbounded && GetCellCoord(x) == GetCellCoord(entry.x) && GetCellCoord(z) == GetCellCoord(entry.z);
+	entry.x = x;
+	entry.y = y;
+	entry.z = z;
+	entry.radius = radius;
+	if (!unbounded) { _maxRadius = std::max(_maxRadius, radius); }
+	if (sameCell && unbounded) { return; } // no box to grow
+	if (sameCell)
+	{
+		// only grow the cell box
+		Cell& cell = _cells[entry.cell];
+		float sphereMin[3] = { x - radius, y - radius, z - radius };
+		float sphereMax[3] = { x + radius, y + radius, z + radius };
+		for (int i = 0; i < 3; i++)
+		{
+			cell.boxMin[i] = std::min(cell.boxMin[i], sphereMin[i]);
+			cell.boxMax[i] = std::max(cell.boxMax[i], sphereMax[i]);
+		}
+		return;
+	}
+	Unlink(id);
+	Link(id);
+}
+void SpatialGrid::Remove(int id)
+{
+	Unlink(id);
+	_freeIds.push_back(id);
+	_count--;
+}
+void SpatialGrid::Clear()
+{
+	_entries.clear();
+	_freeIds.clear();
+	_cells.clear();
+	_cellIndex.clear();
+	_unbounded.clear();
+	_stamps.clear();
+	_maxRadius = 0.0f;
+	_count = 0;
+}
+void SpatialGrid::QueryFrustum(const Frustum& frustum, std::vector<int>& ids) const
+{
+	ids.clear();
+	_candidates.clear();
+	// only cells whose spheres can reach into the frustum's bounds; scan them all
+	// instead when that range holds more cells than there are
+	const float* boundsMin = frustum.GetBoundsMin();
+	const float* boundsMax = frustum.GetBoundsMax();
+	double columns = std::floor((boundsMax[0] + _maxRadius) / _cellSize) - std::floor((boundsMin[0] - _maxRadius) / _cellSize) + 1;
+	double rows = std::floor((boundsMax[2] + _maxRadius) / _cellSize) - std::floor((boundsMin[2] - _maxRadius) / _cellSize) + 1;
+	if (columns * rows < (double)_cells.size())
+	{
+		int column0 = GetCellCoord(boundsMin[0] - _maxRadius), column1 = GetCellCoord(boundsMax[0] + _maxRadius);
+		int row0 = GetCellCoord(boundsMin[2] - _maxRadius), row1 = GetCellCoord(boundsMax[2] + _maxRadius);
+		for (int column = column0; column <= column1; column++)
+		{
+			for (int row = row0; row <= row1; row++)
+			{
+				const Cell* cell = FindCell(column, row);
+				if (!cell || !frustum.TestBox(cell->boxMin, cell->boxMax)) { continue; }
+				_candidates.insert(_candidates.end(), cell->ids.begin(), cell->ids.end());
+			}
+		}
+	}
+	else
+	{
+		for (const Cell& cell : _cells)
+		{
+			if (cell.ids.empty() || !frustum.TestBox(cell.boxMin, cell.boxMax)) { continue; }
+			_candidates.insert(_candidates.end(), cell.ids.begin(), cell.ids.end());
+		}
+	}
+
+	size_t count = _candidates.size();
+	_x.resize(count);
+	_y.resize(count);
+	_z.resize(count);
+	_radius.resize(count);
+	_visible.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		const Entry& entry = _entries[_candidates[i]];
+		_x[i] = entry.x;
+		_y[i] = entry.y;
+		_z[i] = entry.z;
+		_radius[i] = entry.radius;
+	}
+	frustum.TestSpheres(_x.data(), _y.data(), _z.data(), _radius.data(), count, _visible.data());
+	for (size_t i = 0; i < count; i++)
+	{
+		if (_visible[i]) { ids.push_back(_candidates[i]); }
+	}
+	ids.insert(ids.end(), _unbounded.begin(), _unbounded.end());
+}
+void SpatialGrid::QueryRadius(float x, float y, float z, float radius, std::vector<int>& ids) const
+{
+	ids.clear();
+	// any sphere touching the query has its center, and so its cell, within radius + _maxRadius
+	float reach = radius + _maxRadius;
+	int column0 = GetCellCoord(x - reach), column1 = GetCellCoord(x + reach);
+	int row0 = GetCellCoord(z - reach), row1 = GetCellCoord(z + reach);
+	for (int column = column0; column <= column1; column++)
+	{
+		for (int row = row0; row <= row1; row++)
+		{
+			const Cell* cell = FindCell(column, row);
+			if (!cell) { continue; }
+			for (int id : cell->ids)
+			{
+				const Entry& entry = _entries[id];
+				float dx = entry.x - x, dy = entry.y - y, dz = entry.z - z;
+				float limit = entry.radius + radius;
+				if (dx * dx + dy * dy + dz * dz <= limit * limit) { ids.push_back(id); }
+			}
+		}
+	}
+	ids.insert(ids.end(), _unbounded.begin(), _unbounded.end());
+}
+void SpatialGrid::GatherCandidate(int id, const float* origin, const float* direction, float& bestDistance, int& best) const
+{
+	if (_stamps[id] == _stamp) { return; }
+	_stamps[id] = _stamp;
+	const Entry& entry = _entries[id];
+	float distance = IntersectSphere(origin, direction, entry.x, entry.y, entry.z, entry.radius);
+	if (distance >= 0.0f && distance < bestDistance)
+	{
+		bestDistance = distance;
+		best = id;
+	}
+}
+int SpatialGrid::Raycast(const float origin[3], const float direction[3], float maxDistance, float* distance) const
+{
+	float length = sqrtf(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+	if (length == 0.0f || _count == 0) { return -1; }
+	float dir[3] = { direction[0] / length, direction[1] / length, direction[2] / length };
+
+	_stamps.resize(_entries.size(), 0);
+	if (++_stamp == 0)
+	{
+		std::fill(_stamps.begin(), _stamps.end(), 0);
+		_stamp = 1;
+	}
+
+	// walk the cells under the ray (Amanatides & Woo), opening every cell within reach
+	// of _maxRadius around each: a sphere hit at distance t has its center within
+	// _maxRadius of the ray point at t, so the walk can stop once it passes the best hit.
+	// spheres without bound have no first point, so they are never hit
+	int ring = (int)std::ceil(_maxRadius / _cellSize);
+	int column = GetCellCoord(origin[0]), row = GetCellCoord(origin[2]);
+	int stepColumn = dir[0] > 0.0f ? 1 : -1, stepRow = dir[2] > 0.0f ? 1 : -1;
+	float deltaColumn = dir[0] != 0.0f ? _cellSize / std::fabs(dir[0]) : FLT_MAX;
+	float deltaRow = dir[2] != 0.0f ? _cellSize / std::fabs(dir[2]) : FLT_MAX;
+	float nextColumn = dir[0] != 0.0f ? ((column + (stepColumn > 0 ? 1 : 0)) * _cellSize - origin[0]) / dir[0] : FLT_MAX;
+	float nextRow = dir[2] != 0.0f ? ((row + (stepRow > 0 ? 1 : 0)) * _cellSize - origin[2]) / dir[2] : FLT_MAX;
+
+	float bestDistance = maxDistance;
+	int best = -1;
+	float entered = 0.0f;
+	while (entered <= bestDistance)
+	{
+		for (int c = column - ring; c <= column + ring; c++)
+		{
+			for (int r = row - ring; r <= row + ring; r++)
+			{
+				const Cell* cell = FindCell(c, r);
+				if (!cell) { continue; }
+				for (int id : cell->ids) { GatherCandidate(id, origin, dir, bestDistance, best); }
+			}
+		}
+		if (nextColumn == FLT_MAX && nextRow == FLT_MAX) { break; } // straight up or down
+		if (nextColumn < nextRow)
+		{
+			entered = nextColumn;
+			nextColumn += deltaColumn;
+			column += stepColumn;
+		}
+		else
+		{
+			entered = nextRow;
+			nextRow += deltaRow;
+			row += stepRow;
+		}
+	}
+	if (best >= 0 && distance) { *distance = bestDistance; }
+	return best;
+}
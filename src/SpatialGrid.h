@@ -0,0 +1,62 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include "Frustum.h"
+// loose uniform grid over the XZ plane holding bounding spheres. a sphere lives in the
+// cell holding its center and each cell keeps a box grown to fit its spheres (reset
+// once it empties), so moving a sphere costs O(1) and queries only open cells whose box
+// can contain a hit. cells are hashed, so the grid has no fixed extent. spheres without
+// bound are kept out of the cells in a list of their own that every query returns
+class SpatialGrid
+{
+private:
+	struct Entry
+	{
+		float x, y, z, radius;
+		int cell; // -1 for free ids, kUnboundedCell for spheres without bound
+		int slot; // position in the cell's (or the unbounded) id list
+	};
+	struct Cell
+	{
+		std::vector<int> ids;
+		float boxMin[3], boxMax[3];
+	};
+	float _cellSize;
+	float _maxRadius; // largest bounded radius ever inserted, how far a sphere can reach out of its cell
+	std::vector<Entry> _entries;
+	std::vector<int> _freeIds;
+	std::vector<Cell> _cells;
+	std::unordered_map<uint64_t, int> _cellIndex;
+	std::vector<int> _unbounded;
+	size_t _count;
+	// query scratch
+	mutable std::vector<int> _candidates;
+	mutable std::vector<float> _x, _y, _z, _radius;
+	mutable std::vector<unsigned char> _visible;
+	mutable std::vector<unsigned> _stamps;
+	mutable unsigned _stamp;
+	int GetCellCoord(float v) const;
+	const Cell* FindCell(int column, int row) const;
+	void Link(int id);
+	void Unlink(int id);
+	void GatherCandidate(int id, const float* origin, const float* direction, float& bestDistance, int& best) const;
+	SpatialGrid(const SpatialGrid&) = delete;
+	SpatialGrid& operator=(const SpatialGrid&) = delete;
+public:
+	SpatialGrid(float cellSize);
+	// returns the id of the new sphere, stable until it is removed. a radius at or above
+	// kUnboundedRadius has no bound: the sphere touches everything but rays
+	int Insert(float x, float y, float z, float radius);
+	void Update(int id, float x, float y, float z, float radius);
+	void Remove(int id);
+	void Clear();
+	size_t GetCount() const { return _count; }
+	// ids of the spheres touching the frustum, in no particular order
+	void QueryFrustum(const Frustum& frustum, std::vector<int>& ids) const;
+	// ids of the spheres touching the sphere (x, y, z, radius)
+	void QueryRadius(float x, float y, float z, float radius, std::vector<int>& ids) const;
+	// nearest bounded sphere the ray hits within maxDistance, or -1; distance is along
+	// the normalized direction and may be null
+	int Raycast(const float origin[3], const float direction[3], float maxDistance, float* distance) const;
+};
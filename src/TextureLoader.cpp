@@ -0,0 +1,505 @@
+#include "TextureLoader.h"
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <fstream>
+#include <thread>
+#include <cstdint>
+#include <cstdio>
+#include <string.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include "ThreadPool.h"
+#include "TgaReader.h"
+#include "DxtCompressor.h"
+#include "MappedFile.h"
+
+namespace
+{
+	const int kUploadSlots = 3;
+	// ARB_sync is newer than glee, so its entry points are looked up here
+	typedef void* (APIENTRYP FenceSyncProc)(GLenum condition, GLbitfield flags);
+	typedef GLenum (APIENTRYP ClientWaitSyncProc)(void* sync, GLbitfield flags, unsigned long long timeout);
+	typedef void (APIENTRYP DeleteSyncProc)(void* sync);
+	const GLenum kSyncGpuCommandsComplete = 0x9117;
+	const GLenum kAlreadySignaled = 0x911A;
+	const GLenum kConditionSatisfied = 0x911C;
+	const GLbitfield kSyncFlushCommands = 0x00000001;
+	FenceSyncProc pFenceSync = NULL;
+	ClientWaitSyncProc pClientWaitSync = NULL;
+	DeleteSyncProc pDeleteSync = NULL;
+
+	void* GetGlProcAddress(const char* name)
+	{
+#ifdef _WIN32
+		return (void*)wglGetProcAddress(name);
+#elif defined(__APPLE__) || defined(__APPLE_CC__)
+		return NULL;
+#else
+		return (void*)glXGetProcAddressARB((const GLubyte*)name);
+#endif
+	}
+	// a NULL fence counts as passed, nothing was fenced
+	bool HasPassed(void* fence, unsigned long long timeout)
+	{
+		if (fence == NULL) { return true; }
+		GLenum result = pClientWaitSync(fence, kSyncFlushCommands, timeout);
+		return result == kAlreadySignaled || result == kConditionSatisfied;
+	}
+	bool EndsWith(const std::string& text, const char* suffix)
+	{
+		size_t length = strlen(suffix);
+		return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+	}
+	// S3TC cache written next to each image: header, then a width and height for each level,
+	// then the levels' blocks one after the other
+	const char kCacheMagic[4] = { 'D', 'X', 'T', 'C' };
+	const uint32_t kCacheVersion = 2; // 2: source time in nanoseconds
+	const uint32_t kMaxCacheLevels = 32;
+	struct TextureCacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		// identity of the source image
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		uint64_t sourceHash;
+		// contents
+		uint32_t internalFormat;
+		uint32_t powerOfTwo; // level 0 was shrunk to power of two sides
+		uint32_t levelCount;
+		uint32_t dataSize;   // bytes of blocks after the level sizes
+	};
+	struct CacheLevel
+	{
+		uint32_t width;
+		uint32_t height;
+	};
+	static_assert(sizeof(TextureCacheHeader) == 48 && sizeof(CacheLevel) == 8, "cache header must have no hidden padding");
+
+	// fills image from filename's cache, false if there is none or it is stale or damaged
+	bool ReadCache(const std::string& filename, bool powerOfTwo, TextureImage& image)
+	{
+		uint64_t sourceSize = 0;
+		int64_t sourceTime = 0;
+		MappedFile cache;
+		if (!GetFileStamp(filename, sourceSize, sourceTime) || !cache.Open(filename + ".cache")) { return false; }
+		size_t size = cache.Size();
+		if (size < sizeof(TextureCacheHeader)) { return false; }
+		TextureCacheHeader header;
+		memcpy(&header, cache.Data(), sizeof(header));
+		if (memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 || header.version != kCacheVersion
+			|| header.sourceSize != sourceSize || header.powerOfTwo != (powerOfTwo ? 1u : 0u)
+			|| (header.internalFormat != GL_COMPRESSED_RGB_S3TC_DXT1_EXT && header.internalFormat != GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+			|| header.levelCount == 0 || header.levelCount > kMaxCacheLevels
+			|| size != sizeof(header) + header.levelCount * sizeof(CacheLevel) + header.dataSize)
+		{
+			return false;
+		}
+		if (header.sourceTime != sourceTime)
+		{
+			// touched but maybe not edited (e.g. a fresh checkout), compare contents
+			MappedFile source;
+			if (!source.Open(filename) || HashBytes(source.Data(), source.Size()) != header.sourceHash) { return false; }
+		}
+		const CacheLevel* levels = (const CacheLevel*)(cache.Data() + sizeof(header));
+		size_t offset = 0;
+		image.chain.levels.clear();
+		for (uint32_t i = 0; i < header.levelCount; i++)
+		{
+			if (levels[i].width == 0 || levels[i].height == 0 || levels[i].width > 65536 || levels[i].height > 65536) { return false; }
+			image.chain.levels.push_back({ (GLint)levels[i].width, (GLint)levels[i].height, offset });
+			offset += DxtLevelSize(levels[i].width, levels[i].height, header.internalFormat);
+		}
+		if (offset != header.dataSize) { return false; }
+		const GLubyte* blocks = (const GLubyte*)(levels + header.levelCount);
+		image.chain.pixels.assign(blocks, blocks + header.dataSize);
+		image.internalFormat = header.internalFormat;
+		image.compressed = true;
+		image.cached = true;
+		return true;
+	}
+	// writes to a temporary file first so a crash never leaves a half-written cache behind.
+	// the temporary file is the thread's own, as the same image may be compressed twice at once
+	void WriteCache(const std::string& filename, bool powerOfTwo, const TextureImage& image)
+	{
+		TextureCacheHeader header;
+		memset(&header, 0, sizeof(header));
+		MappedFile source;
+		if (!GetFileStamp(filename, header.sourceSize, header.sourceTime) || !source.Open(filename)) { return; }
+		memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+		header.version = kCacheVersion;
+		header.sourceHash = HashBytes(source.Data(), source.Size());
+		header.internalFormat = image.internalFormat;
+		header.powerOfTwo = powerOfTwo ? 1 : 0;
+		header.levelCount = (uint32_t)image.chain.levels.size();
+		header.dataSize = (uint32_t)image.chain.pixels.size();
+		source.Close();
+
+		std::string cacheName = filename + ".cache";
+		std::ostringstream tempName;
+		tempName << cacheName << "." << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+		{
+			std::ofstream out(tempName.str(), std::ios::binary | std::ios::trunc);
+			if (!out) { return; }
+			out.write((const char*)&header, sizeof(header));
+			for (const MipLevel& mip : image.chain.levels)
+			{
+				CacheLevel level = { (uint32_t)mip.width, (uint32_t)mip.height };
+				out.write((const char*)&level, sizeof(level));
+			}
+			out.write((const char*)image.chain.pixels.data(), image.chain.pixels.size());
+			if (!out) { out.close(); std::remove(tempName.str().c_str()); return; }
+		}
+		std::remove(cacheName.c_str()); // rename does not replace on windows
+		if (std::rename(tempName.str().c_str(), cacheName.c_str()) != 0) { std::remove(tempName.str().c_str()); }
+	}
+}
+
+TextureImage TextureLoader::Decode(const std::string& filename, bool powerOfTwo, bool compress)
+{
+	std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+	TextureImage image;
+	image.internalFormat = GL_RGB8;
+	image.format = GL_BGRA_EXT;
+	image.compressed = false;
+	image.cached = false;
+	image.chain.channels = 4;
+	if (compress && ReadCache(filename, powerOfTwo, image))
+	{
+		image.decodeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+		return image;
+	}
+	GLint width = 0, height = 0, channels = 3;
+	cv::Mat decoded; // the opencv image pixels points into
+	const GLubyte* pixels = NULL;
+	// each worker keeps its reader, so the buffers of one targa are reused for the next
+	thread_local TgaReader tga;
+	if (EndsWith(filename, ".tga"))
+	{
+		if (tga.Open(filename))
+		{
+			width = tga.Width();
+			height = tga.Height();
+			channels = tga.Channels();
+			image.internalFormat = tga.InternalFormat();
+			pixels = tga.Pixels();
+		}
+	}
+	else
+	{
+		decoded = cv::imread(filename);
+		if (!decoded.empty())
+		{
+			FlipRows(decoded.ptr(), decoded.step, decoded.rows);
+			width = decoded.cols;
+			height = decoded.rows;
+			image.internalFormat = GL_RGB;
+			pixels = decoded.ptr();
+		}
+	}
+	if (pixels != NULL)
+	{
+		BuildMipChain(pixels, width, height, channels, powerOfTwo ? FloorPowerOfTwo(width) : width,
+			powerOfTwo ? FloorPowerOfTwo(height) : height, image.chain);
+		image.format = image.chain.channels == 1 ? GL_LUMINANCE : GL_BGRA_EXT;
+	}
+	tga.Close();
+	if (compress && !image.chain.levels.empty() && image.chain.channels == 4)
+	{
+		// DXT1 unless the image has alpha below 255 somewhere
+		bool opaque = true;
+		size_t baseBytes = (size_t)image.chain.levels[0].width * image.chain.levels[0].height * 4;
+		for (size_t i = 3; opaque && channels == 4 && i < baseBytes; i += 4)
+		{
+			opaque = image.chain.pixels[i] == 255;
+		}
+		image.internalFormat = opaque ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		MipChain blocks;
+		CompressMipChain(image.chain, image.internalFormat, blocks);
+		image.chain = std::move(blocks);
+		image.compressed = true;
+		WriteCache(filename, powerOfTwo, image);
+	}
+	image.decodeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	return image;
+}
+TextureLoader::TextureLoader()
+{
+	_initialized = false;
+	_streaming = false;
+	_allowCompression = true;
+	_compress = false;
+	_powerOfTwo = false;
+	_maxSize = 0;
+	_decodeMs = 0.0;
+	_compressedCount = 0;
+	_cachedCount = 0;
+	_compressedBytes = 0;
+	_pixelBytes = 0;
+}
+void TextureLoader::Initialize()
+{
+	_initialized = true;
+	_powerOfTwo = !GLEE_VERSION_2_0 && !GLEE_ARB_texture_non_power_of_two;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &_maxSize);
+	_compress = _allowCompression && GLEE_ARB_texture_compression && GLEE_EXT_texture_compression_s3tc;
+	if (_allowCompression && !_compress) { std::cout << "no S3TC, textures upload uncompressed" << std::endl; }
+	_streaming = GLEE_ARB_pixel_buffer_object;
+	if (!_streaming) { return; }
+	if (gltIsExtSupported("GL_ARB_sync"))
+	{
+		pFenceSync = (FenceSyncProc)GetGlProcAddress("glFenceSync");
+		pClientWaitSync = (ClientWaitSyncProc)GetGlProcAddress("glClientWaitSync");
+		pDeleteSync = (DeleteSyncProc)GetGlProcAddress("glDeleteSync");
+	}
+	if (pFenceSync == NULL || pClientWaitSync == NULL || pDeleteSync == NULL)
+	{
+		// orphaning each buffer before it is mapped again still keeps gl's pending read intact
+		std::cout << "no fences for texture streaming, reusing pixel buffers by orphaning them" << std::endl;
+		pFenceSync = NULL;
+	}
+	_slots.resize(kUploadSlots);
+	for (Slot& slot : _slots)
+	{
+		glGenBuffersARB(1, &slot.buffer);
+		slot.mapped = false;
+		slot.reading = false;
+		slot.fence = NULL;
+	}
+}
+void TextureLoader::Add(GLuint texture, const char* filename, GLenum wrap)
+{
+	if (!_initialized) { Initialize(); }
+	// a newer image wins over one that is still decoding
+	_requests.erase(std::remove_if(_requests.begin(), _requests.end(), [texture](const Request& request)
+	{
+		return request.texture == texture && request.stage == kDecoding;
+	}), _requests.end());
+	Request request;
+	request.texture = texture;
+	request.filename = filename;
+	request.wrap = wrap;
+	request.stage = kDecoding;
+	request.slot = -1;
+	std::string name = request.filename;
+	bool powerOfTwo = _powerOfTwo, compress = _compress;
+	request.decode = ThreadPool::Shared().Submit([name, powerOfTwo, compress] { return Decode(name, powerOfTwo, compress); });
+	_requests.push_back(std::move(request));
+}
+// a texture's requests upload in the order they were added
+bool TextureLoader::IsBlocked(size_t index) const
+{
+	for (size_t i = 0; i < index; i++)
+	{
+		if (_requests[i].texture == _requests[index].texture) { return true; }
+	}
+	return false;
+}
+int TextureLoader::FindFreeSlot() const
+{
+	for (size_t i = 0; i < _slots.size(); i++)
+	{
+		if (!_slots[i].mapped && !_slots[i].reading) { return (int)i; }
+	}
+	return -1;
+}
+void TextureLoader::UploadChain(const TextureImage& image, size_t base, GLint maxSize)
+{
+	// levels are packed, whatever their width
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	GLint level = 0;
+	for (const MipLevel& mip : image.chain.levels)
+	{
+		// gl starts at the first level it can hold
+		if (mip.width > maxSize || mip.height > maxSize) { continue; }
+		if (image.compressed)
+		{
+			glCompressedTexImage2DARB(GL_TEXTURE_2D, level++, image.internalFormat, mip.width, mip.height, 0,
+				(GLsizei)DxtLevelSize(mip.width, mip.height, image.internalFormat), (const GLvoid*)(base + mip.offset));
+		}
+		else
+		{
+			glTexImage2D(GL_TEXTURE_2D, level++, image.internalFormat, mip.width, mip.height, 0, image.format,
+				GL_UNSIGNED_BYTE, (const GLvoid*)(base + mip.offset));
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+// binds request's texture with its filtering and wrap, then uploads its chain from base
+void TextureLoader::UploadLevels(const Request& request, size_t base)
+{
+	glBindTexture(GL_TEXTURE_2D, request.texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, request.wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, request.wrap);
+	UploadChain(request.image, base, _maxSize);
+}
+// from client memory, blocking until gl has copied the pixels
+void TextureLoader::Upload(const Request& request)
+{
+	if (request.image.chain.levels.empty())
+	{
+		std::cout << "cannot load " << request.filename << std::endl;
+		return;
+	}
+	UploadLevels(request, (size_t)request.image.chain.pixels.data());
+}
+void TextureLoader::StartCopy(Request& request, int slot)
+{
+	size_t bytes = request.image.chain.pixels.size();
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, _slots[slot].buffer);
+	// orphan the old storage rather than wait for a read of it that may still be pending
+	glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, bytes, NULL, GL_STREAM_DRAW_ARB);
+	GLubyte* mapped = (GLubyte*)glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+	// unbound again, other uploads read client memory
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	if (mapped == NULL)
+	{
+		Upload(request);
+		return;
+	}
+	_slots[slot].mapped = true;
+	request.stage = kCopying;
+	request.slot = slot;
+	const GLubyte* pixels = request.image.chain.pixels.data();
+	request.copy = ThreadPool::Shared().Submit([mapped, pixels, bytes] { memcpy(mapped, pixels, bytes); });
+}
+void TextureLoader::FinishCopy(Request& request)
+{
+	Slot& slot = _slots[request.slot];
+	request.copy.get();
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, slot.buffer);
+	// false if the buffer's contents were lost while mapped (a mode switch), then the
+	// pixels are still in memory
+	bool intact = glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB) == GL_TRUE;
+	if (intact) { UploadLevels(request, 0); }
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	if (!intact) { Upload(request); }
+	slot.mapped = false;
+	slot.reading = true;
+	slot.fence = pFenceSync != NULL ? pFenceSync(kSyncGpuCommandsComplete, 0) : NULL;
+}
+bool TextureLoader::Update()
+{
+	if (!_initialized) { Initialize(); }
+	bool moved = false;
+	// buffers gl is done reading go back to the ring
+	for (Slot& slot : _slots)
+	{
+		if (slot.reading && HasPassed(slot.fence, 0))
+		{
+			if (slot.fence != NULL) { pDeleteSync(slot.fence); }
+			slot.fence = NULL;
+			slot.reading = false;
+			moved = true;
+		}
+	}
+	size_t i = 0;
+	while (i < _requests.size())
+	{
+		Request& request = _requests[i];
+		if (request.stage == kCopying && request.copy.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		{
+			FinishCopy(request);
+			_requests.erase(_requests.begin() + i);
+			moved = true;
+			continue;
+		}
+		int slot = _streaming ? FindFreeSlot() : -1;
+		if (request.stage == kDecoding && (slot >= 0 || !_streaming) && !IsBlocked(i)
+			&& request.decode.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		{
+			request.image = request.decode.get();
+			_decodeMs += request.image.decodeMs;
+			if (request.image.compressed)
+			{
+				_compressedCount++;
+				_cachedCount += request.image.cached ? 1 : 0;
+				_compressedBytes += request.image.chain.pixels.size();
+				for (const MipLevel& mip : request.image.chain.levels) { _pixelBytes += (size_t)mip.width * mip.height * 4; }
+			}
+			moved = true;
+			if (_streaming && !request.image.chain.levels.empty()) { StartCopy(request, slot); }
+			else { Upload(request); }
+			if (request.stage == kDecoding)
+			{
+				// uploaded already
+				_requests.erase(_requests.begin() + i);
+				continue;
+			}
+		}
+		i++;
+	}
+	return moved;
+}
+// blocks until the next Update can move something
+void TextureLoader::Wait()
+{
+	for (Request& request : _requests)
+	{
+		if (request.stage == kCopying)
+		{
+			request.copy.wait();
+			return;
+		}
+	}
+	for (Slot& slot : _slots)
+	{
+		if (slot.reading && FindFreeSlot() < 0)
+		{
+			if (slot.fence != NULL) { HasPassed(slot.fence, 1000000000ull); }
+			return;
+		}
+	}
+	if (!_requests.empty()) { _requests.front().decode.wait(); }
+}
+void TextureLoader::UploadAll()
+{
+	std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+	double decodeStart = _decodeMs;
+	int compressedStart = _compressedCount, cachedStart = _cachedCount;
+	size_t compressedBytesStart = _compressedBytes, pixelBytesStart = _pixelBytes;
+	double waitMs = 0.0;
+	size_t count = _requests.size();
+	while (!_requests.empty())
+	{
+		if (Update()) { continue; }
+		std::chrono::high_resolution_clock::time_point waitStart = std::chrono::high_resolution_clock::now();
+		Wait();
+		waitMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - waitStart).count();
+	}
+	double totalMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	std::ostringstream status;
+	status << "textures: " << count << " decoded and mipmapped in " << _decodeMs - decodeStart << " ms of pool time, waited " << waitMs
+		<< " ms for them, uploaded in " << totalMs - waitMs << " ms" << (_streaming ? " through pixel buffers" : "") << std::endl;
+	if (_compressedCount > compressedStart)
+	{
+		status << "textures: " << _compressedCount - compressedStart << " in S3TC, " << _cachedCount - cachedStart << " of them read from their caches, "
+			<< (_compressedBytes - compressedBytesStart) / 1024 << " KB instead of " << (_pixelBytes - pixelBytesStart) / 1024 << " KB" << std::endl;
+	}
+	std::cout << status.str();
+}
+void TextureLoader::Release()
+{
+	for (Request& request : _requests)
+	{
+		if (request.stage == kCopying)
+		{
+			request.copy.wait();
+			glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, _slots[request.slot].buffer);
+			glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+		}
+	}
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	_requests.clear();
+	for (Slot& slot : _slots)
+	{
+		if (slot.fence != NULL) { pDeleteSync(slot.fence); }
+		glDeleteBuffersARB(1, &slot.buffer);
+	}
+	_slots.clear();
+	_initialized = false;
+}
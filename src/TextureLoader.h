@@ -0,0 +1,91 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <future>
+#include "gltools.h"
+#include "MipChain.h"
+// one image file, decoded and mipmapped off the gl thread
+struct TextureImage
+{
+	GLint internalFormat; // an S3TC format when compressed
+	GLenum format;      // GL_BGRA_EXT or GL_LUMINANCE, how chain's pixels are laid out
+	bool compressed;    // chain holds S3TC blocks instead of pixels
+	bool cached;        // the blocks were read from the file's cache, nothing was decoded
+	MipChain chain;     // no levels if the file could not be read
+	double decodeMs;    // decoding and building the chain
+};
+
+// decodes textures and builds their mip chains on the shared thread pool, and streams them to
+// gl through a ring of pixel buffer objects: a worker copies the levels into a mapped buffer,
+// then the gl thread sources glTexImage2D from it and fences the buffer until gl has read it.
+// without pixel buffer support the levels are uploaded straight from memory. where gl has
+// S3TC, color textures are compressed once and kept in a cache file beside their image
+class TextureLoader
+{
+private:
+	enum Stage { kDecoding, kCopying };
+	struct Request
+	{
+		GLuint texture;
+		std::string filename;
+		GLenum wrap;
+		Stage stage;
+		std::future<TextureImage> decode;
+		TextureImage image;
+		int slot;                // pixel buffer the worker is filling, while copying
+		std::future<void> copy;
+	};
+	struct Slot
+	{
+		GLuint buffer;
+		bool mapped;             // a worker is filling it
+		bool reading;            // gl may still be reading it, until fence passes
+		void* fence;             // ARB_sync fence after the read, NULL to free it next update
+	};
+	std::vector<Request> _requests;
+	std::vector<Slot> _slots;
+	bool _initialized;
+	bool _streaming;
+	bool _allowCompression;
+	bool _compress;
+	bool _powerOfTwo;        // gl without non power of two textures
+	GLint _maxSize;
+	double _decodeMs;
+	int _compressedCount;
+	int _cachedCount;
+	size_t _compressedBytes;
+	size_t _pixelBytes;      // the compressed textures would take as BGRA
+	void Initialize();
+	bool IsBlocked(size_t index) const;
+	int FindFreeSlot() const;
+	void StartCopy(Request& request, int slot);
+	void FinishCopy(Request& request);
+	void Wait();
+	void UploadLevels(const Request& request, size_t base);
+	void Upload(const Request& request);
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator=(const TextureLoader&) = delete;
+public:
+	TextureLoader();
+	// false uploads every texture uncompressed; only read before the first Add
+	void SetCompression(bool allow) { _allowCompression = allow; }
+	// starts decoding filename for texture, replacing a pending decode for the same texture.
+	// textures are filtered trilinearly, wrap is the mode for both s and t
+	void Add(GLuint texture, const char* filename, GLenum wrap);
+	// moves every texture along as far as it can go without waiting, once a frame on the
+	// gl thread. true if anything moved
+	bool Update();
+	// waits until every texture is uploaded, for startup
+	void UploadAll();
+	// frees the pixel buffers, while the context is still current
+	void Release();
+	bool IsIdle() const { return _requests.empty(); }
+	// .tga files go through TgaReader, the rest through opencv. powerOfTwo shrinks the
+	// image to the power of two sides below its own before building the chain. compress
+	// returns color images as S3TC blocks, read from filename + ".cache" when that is up to
+	// date and compressed and written there otherwise
+	static TextureImage Decode(const std::string& filename, bool powerOfTwo, bool compress);
+	// image's levels into the bound texture, each read from base + its offset: client memory,
+	// or the bound pixel unpack buffer. levels wider or taller than maxSize are left out
+	static void UploadChain(const TextureImage& image, size_t base, GLint maxSize);
+};
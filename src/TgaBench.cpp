@@ -0,0 +1,185 @@
+#include "TgaBench.h"
+#include "BenchTiming.h"
+#include "TgaReader.h"
+#include "math3d.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+namespace
+{
+	double MegabytesPerSecond(size_t bytes, double ms) { return bytes / (ms * 1000.0); }
+	// reads every byte, so a mapped file pays for its page faults like fread does
+	unsigned Checksum(const GLubyte* bytes, size_t size)
+	{
+		unsigned sum = 0;
+		for (size_t i = 0; i < size; i++) { sum += bytes[i]; }
+		return sum;
+	}
+
+	std::vector<GLubyte> MakeTga(int type, int width, int height, int depth, int descriptor,
+		const std::vector<GLubyte>& map, int mapDepth, const std::vector<GLubyte>& body)
+	{
+		std::vector<GLubyte> file(18, 0);
+		int entries = map.empty() ? 0 : (int)map.size() / (mapDepth / 8);
+		file[1] = map.empty() ? 0 : 1;
+		file[2] = (GLubyte)type;
+		file[5] = (GLubyte)entries;
+		file[6] = (GLubyte)(entries >> 8);
+		file[7] = (GLubyte)(map.empty() ? 0 : mapDepth);
+		file[12] = (GLubyte)width;
+		file[13] = (GLubyte)(width >> 8);
+		file[14] = (GLubyte)height;
+		file[15] = (GLubyte)(height >> 8);
+		file[16] = (GLubyte)depth;
+		file[17] = (GLubyte)descriptor;
+		file.insert(file.end(), map.begin(), map.end());
+		file.insert(file.end(), body.begin(), body.end());
+		return file;
+	}
+	// run packets for two or more equal pixels, raw packets between them. packets run
+	// across rows, which the reader has to allow
+	std::vector<GLubyte> EncodeRuns(const std::vector<GLubyte>& pixels, int bytes)
+	{
+		std::vector<GLubyte> out;
+		size_t count = pixels.size() / bytes;
+		auto same = [&](size_t a, size_t b) { return memcmp(&pixels[a * bytes], &pixels[b * bytes], bytes) == 0; };
+		for (size_t i = 0; i < count;)
+		{
+			size_t run = 1;
+			while (i + run < count && run < 128 && same(i, i + run)) { run++; }
+			if (run == 1)
+			{
+				while (i + run < count && run < 128 && !(i + run + 1 < count && same(i + run, i + run + 1))) { run++; }
+				out.push_back((GLubyte)(run - 1));
+				out.insert(out.end(), pixels.begin() + i * bytes, pixels.begin() + (i + run) * bytes);
+			}
+			else
+			{
+				out.push_back((GLubyte)(0x80 | (run - 1)));
+				out.insert(out.end(), pixels.begin() + i * bytes, pixels.begin() + (i + 1) * bytes);
+			}
+			i += run;
+		}
+		return out;
+	}
+
+	struct Variant
+	{
+		std::string name;
+		std::vector<GLubyte> file;
+		std::vector<GLubyte> expected; // what the reader should give back
+		bool runLength;
+	};
+	// grass rewritten as each kind of targa the reader handles. the banded ones repeat every
+	// sixteenth pixel of a row, for runs long enough to show the run expander
+	std::vector<Variant> MakeVariants(const std::vector<GLubyte>& bgr, int width, int height)
+	{
+		size_t count = (size_t)width * height;
+		std::vector<GLubyte> banded(bgr.size()), top(bgr.size());
+		for (size_t i = 0; i < count; i++) { memcpy(&banded[i * 3], &bgr[(i & ~(size_t)15) * 3], 3); }
+		for (int y = 0; y < height; y++)
+		{
+			memcpy(&top[(size_t)y * width * 3], &bgr[(size_t)(height - 1 - y) * width * 3], (size_t)width * 3);
+		}
+		std::vector<GLubyte> none, bgra(count * 4), words(count * 2), wordPixels(count * 3), gray(count);
+		std::vector<GLubyte> indices(count), map(256 * 3), mapped(count * 3);
+		for (int i = 0; i < 256; i++)
+		{
+			map[i * 3] = (GLubyte)((i & 3) * 255 / 3);
+			map[i * 3 + 1] = (GLubyte)((i >> 2 & 7) * 255 / 7);
+			map[i * 3 + 2] = (GLubyte)((i >> 5) * 255 / 7);
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			const GLubyte* p = &banded[i * 3];
+			memcpy(&bgra[i * 4], p, 3);
+			bgra[i * 4 + 3] = 255;
+			int b = p[0] >> 3, g = p[1] >> 3, r = p[2] >> 3, word = r << 10 | g << 5 | b;
+			words[i * 2] = (GLubyte)word;
+			words[i * 2 + 1] = (GLubyte)(word >> 8);
+			wordPixels[i * 3] = (GLubyte)(b << 3 | b >> 2);
+			wordPixels[i * 3 + 1] = (GLubyte)(g << 3 | g >> 2);
+			wordPixels[i * 3 + 2] = (GLubyte)(r << 3 | r >> 2);
+			gray[i] = p[1];
+			indices[i] = (GLubyte)((p[2] >> 5) << 5 | (p[1] >> 5) << 2 | p[0] >> 6);
+			memcpy(&mapped[i * 3], &map[indices[i] * 3], 3);
+		}
+		std::vector<Variant> variants;
+		variants.push_back({ "24 bit top origin", MakeTga(2, width, height, 24, 0x20, none, 0, top), bgr, false });
+		variants.push_back({ "24 bit run length", MakeTga(10, width, height, 24, 0, none, 0, EncodeRuns(bgr, 3)), bgr, true });
+		variants.push_back({ "24 bit run length banded", MakeTga(10, width, height, 24, 0, none, 0, EncodeRuns(banded, 3)), banded, true });
+		variants.push_back({ "32 bit run length banded", MakeTga(10, width, height, 32, 8, none, 0, EncodeRuns(bgra, 4)), bgra, true });
+		variants.push_back({ "16 bit run length banded", MakeTga(10, width, height, 16, 0, none, 0, EncodeRuns(words, 2)), wordPixels, true });
+		variants.push_back({ "color mapped", MakeTga(1, width, height, 8, 0, map, 24, indices), mapped, false });
+		variants.push_back({ "color mapped run length", MakeTga(9, width, height, 8, 0, map, 24, EncodeRuns(indices, 1)), mapped, true });
+		variants.push_back({ "gray run length", MakeTga(11, width, height, 8, 0, none, 0, EncodeRuns(gray, 1)), gray, true });
+		return variants;
+	}
+}
+
+int RunTgaBenchmark(int repeats)
+{
+	const char* file = "./tga/grass.tga";
+	GLint width = 0, height = 0, components = 0;
+	GLenum format = 0;
+	GLbyte* bits = gltLoadTGA(file, &width, &height, &components, &format);
+	if (bits == NULL || format != GL_BGR_EXT)
+	{
+		std::cout << "bench tga: cannot load " << file << " as 24 bit" << std::endl;
+		free(bits);
+		return 1;
+	}
+	size_t size = (size_t)width * height * 3;
+	std::vector<GLubyte> bgr((GLubyte*)bits, (GLubyte*)bits + size);
+	free(bits);
+
+	M3DSimdLevel best = m3dGetSimdLevel();
+	std::cout << "bench tga: best of " << repeats << ", cpu supports " << m3dGetSimdLevelName(best) << std::endl;
+	volatile unsigned sum = 0; // keeps the reads from being optimized away
+	double freadMs = TimeBest(repeats, [&]()
+	{
+		GLbyte* loaded = gltLoadTGA(file, &width, &height, &components, &format);
+		sum = sum + Checksum((const GLubyte*)loaded, size);
+		free(loaded);
+	});
+	TgaReader reader;
+	bool inPlace = false;
+	double readerMs = TimeBest(repeats, [&]()
+	{
+		reader.Open(file);
+		sum = sum + Checksum(reader.Pixels(), size);
+		inPlace = reader.IsInPlace();
+		reader.Close();
+	});
+	reader.Open(file);
+	bool allSame = reader.Pixels() != NULL && memcmp(reader.Pixels(), bgr.data(), size) == 0;
+	reader.Close();
+	std::cout << "bench tga " << file << " " << width << "x" << height << ", reading every byte once: gltLoadTGA "
+		<< freadMs << " ms (" << MegabytesPerSecond(size, freadMs) << " MB/s), TgaReader " << readerMs << " ms ("
+		<< MegabytesPerSecond(size, readerMs) << " MB/s, " << (inPlace ? "in place" : "copied") << "), "
+		<< freadMs / readerMs << "x" << (allSame ? "" : ", MISMATCH against gltLoadTGA") << std::endl;
+
+	for (const Variant& variant : MakeVariants(bgr, width, height))
+	{
+		double scalarMs = 0.0;
+		for (int level = variant.runLength ? M3D_SIMD_SCALAR : best; level <= best; level++)
+		{
+			m3dSetSimdLevel((M3DSimdLevel)level);
+			double ms = TimeBest(repeats, [&]() { reader.Decode(variant.file.data(), variant.file.size()); });
+			if (level == M3D_SIMD_SCALAR) { scalarMs = ms; }
+			size_t bytes = (size_t)reader.Width() * reader.Height() * reader.Channels();
+			bool same = bytes == variant.expected.size() && memcmp(reader.Pixels(), variant.expected.data(), bytes) == 0;
+			allSame = allSame && same;
+			std::cout << "bench tga " << variant.name << " (" << variant.file.size() / 1024 << " KB) " << m3dGetSimdLevelName((M3DSimdLevel)level)
+				<< ": " << ms << " ms, " << MegabytesPerSecond(bytes, ms) << " MB/s";
+			if (variant.runLength && level != M3D_SIMD_SCALAR) { std::cout << ", " << scalarMs / ms << "x scalar"; }
+			std::cout << (same ? "" : ", MISMATCH") << std::endl;
+		}
+		m3dSetSimdLevel(best);
+	}
+	return allSame ? 0 : 1;
+}
@@ -0,0 +1,6 @@
+#pragma once
+// benchmark of the targa reader (--bench-tga): times TgaReader against gltLoadTGA's fread path
+// on the shipped grass.tga, then decodes it rewritten as every other kind of targa (top
+// origin, run length encoded, color mapped, 16 bit, gray) at every SIMD level the CPU supports,
+// checking each against the pixels it was written from
+int RunTgaBenchmark(int repeats);
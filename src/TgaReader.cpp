@@ -0,0 +1,280 @@
+#include "TgaReader.h"
+#include "MipChain.h"
+#include "math3d.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define TGA_X86
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#define TGA_TARGET(isa)
+#else
+#define TGA_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace
+{
+	const size_t kHeaderSize = 18;
+	enum { kColorMapped = 1, kTrueColor = 2, kGray = 3, kRunLength = 8 };
+	const int kTopOrigin = 0x20;
+	const int kRightOrigin = 0x10;
+
+	struct Header
+	{
+		int idLength;
+		int colorMapType;
+		int imageType;
+		int mapFirst;
+		int mapLength;
+		int mapDepth;
+		int width;
+		int height;
+		int depth;
+		int descriptor;
+	};
+	// targa numbers are little endian
+	int Word(const GLubyte* p) { return p[0] | p[1] << 8; }
+	Header ReadHeader(const GLubyte* p)
+	{
+		Header header;
+		header.idLength = p[0];
+		header.colorMapType = p[1];
+		header.imageType = p[2];
+		header.mapFirst = Word(p + 3);
+		header.mapLength = Word(p + 5);
+		header.mapDepth = p[7];
+		header.width = Word(p + 12);
+		header.height = Word(p + 14);
+		header.depth = p[16];
+		header.descriptor = p[17];
+		return header;
+	}
+	bool IsColorDepth(int depth) { return depth == 15 || depth == 16 || depth == 24 || depth == 32; }
+	// 16 bit pixels only have alpha when the descriptor gives them an attribute bit
+	int ChannelsOf(int depth, int descriptor)
+	{
+		return depth == 32 || (depth == 16 && (descriptor & 15) != 0) ? 4 : 3;
+	}
+	GLubyte Widen5(int value) { return (GLubyte)(value << 3 | value >> 2); }
+	// 15 and 16 bit pixels are A1R5G5B5
+	void Unpack16(const GLubyte* in, GLubyte* out, int channels)
+	{
+		int value = Word(in);
+		out[0] = Widen5(value & 31);
+		out[1] = Widen5(value >> 5 & 31);
+		out[2] = Widen5(value >> 10 & 31);
+		if (channels == 4) { out[3] = (value & 0x8000) ? 255 : 0; }
+	}
+
+	void FillRunScalar(GLubyte* out, const GLubyte* pixel, int bytes, size_t count)
+	{
+		for (size_t i = 0; i < count; i++, out += bytes)
+		{
+			for (int b = 0; b < bytes; b++) { out[b] = pixel[b]; }
+		}
+	}
+#ifdef TGA_X86
+	// the pixel repeated across a register, sixteen bytes per store. 3 byte pixels fit five to
+	// a register with the first byte of a sixth, which the next store or the tail writes again
+	TGA_TARGET("sse2") void FillRunSSE2(GLubyte* out, const GLubyte* pixel, int bytes, size_t count)
+	{
+		size_t i = 0;
+		if (bytes == 3)
+		{
+			GLubyte pattern[16];
+			for (int b = 0; b < 16; b++) { pattern[b] = pixel[b % 3]; }
+			__m128i value = _mm_loadu_si128((const __m128i*)pattern);
+			for (; i + 6 <= count; i += 5) { _mm_storeu_si128((__m128i*)(out + i * 3), value); }
+		}
+		else
+		{
+			unsigned word = bytes == 4 ? pixel[0] | pixel[1] << 8 | pixel[2] << 16 | (unsigned)pixel[3] << 24 : Word(pixel) * 0x10001u;
+			__m128i value = _mm_set1_epi32((int)word);
+			size_t step = 16 / bytes;
+			for (; i + step <= count; i += step) { _mm_storeu_si128((__m128i*)(out + i * bytes), value); }
+		}
+		FillRunScalar(out + i * bytes, pixel, bytes, count - i);
+	}
+#endif
+	void FillRun(GLubyte* out, const GLubyte* pixel, int bytes, size_t count, bool sse2)
+	{
+		if (bytes == 1) { memset(out, pixel[0], count); }
+#ifdef TGA_X86
+		else if (sse2) { FillRunSSE2(out, pixel, bytes, count); }
+#endif
+		else { FillRunScalar(out, pixel, bytes, count); }
+	}
+	// run length packets into count pixels of bytes each: a header byte, then one pixel
+	// repeated header - 127 times or header + 1 raw pixels. packets may cross rows, and the
+	// last is cut at the end of the image. false if size runs out first
+	bool ExpandRuns(const GLubyte* in, size_t size, int bytes, size_t count, GLubyte* out)
+	{
+		bool sse2 = m3dGetSimdLevel() >= M3D_SIMD_SSE2;
+		const GLubyte* end = in + size;
+		size_t done = 0;
+		while (done < count)
+		{
+			if (in == end) { return false; }
+			int header = *in++;
+			size_t length = std::min((size_t)(header & 0x7f) + 1, count - done);
+			size_t packetBytes = (header & 0x80) ? bytes : length * bytes;
+			if ((size_t)(end - in) < packetBytes) { return false; }
+			if (header & 0x80) { FillRun(out + done * bytes, in, bytes, length, sse2); }
+			else { memcpy(out + done * bytes, in, packetBytes); }
+			in += packetBytes;
+			done += length;
+		}
+		return true;
+	}
+
+	void MirrorRows(GLubyte* pixels, int width, int height, int channels)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			GLubyte* row = pixels + (size_t)y * width * channels;
+			for (int left = 0, right = width - 1; left < right; left++, right--)
+			{
+				std::swap_ranges(row + left * channels, row + (left + 1) * channels, row + right * channels);
+			}
+		}
+	}
+}
+
+TgaReader::TgaReader()
+{
+	_data = nullptr;
+	_width = 0;
+	_height = 0;
+	_channels = 0;
+}
+bool TgaReader::Open(const std::string& filename)
+{
+	Close();
+	if (!_file.Open(filename)) { return false; }
+	if (Decode((const GLubyte*)_file.Data(), _file.Size())) { return true; }
+	Close();
+	return false;
+}
+void TgaReader::Close()
+{
+	if (IsInPlace()) { _data = nullptr; }
+	_file.Close();
+}
+GLenum TgaReader::Format() const
+{
+	return _channels == 1 ? GL_LUMINANCE : _channels == 4 ? GL_BGRA_EXT : GL_BGR_EXT;
+}
+GLint TgaReader::InternalFormat() const
+{
+	return _channels == 1 ? GL_LUMINANCE8 : _channels == 4 ? GL_RGBA8 : GL_RGB8;
+}
+bool TgaReader::Decode(const GLubyte* data, size_t size)
+{
+	_data = nullptr;
+	_width = _height = _channels = 0;
+	if (size < kHeaderSize) { return false; }
+	Header header = ReadHeader(data);
+	int kind = header.imageType & ~kRunLength;
+	bool runLength = (header.imageType & kRunLength) != 0;
+	if (header.imageType > (kGray | kRunLength) || kind < kColorMapped || kind > kGray) { return false; }
+	if (header.width == 0 || header.height == 0) { return false; }
+	bool mapped = kind == kColorMapped;
+	int channels;
+	if (mapped)
+	{
+		if (header.colorMapType != 1 || header.mapLength == 0 || !IsColorDepth(header.mapDepth)) { return false; }
+		if (header.depth != 8 && header.depth != 16) { return false; }
+		channels = ChannelsOf(header.mapDepth, header.descriptor);
+	}
+	else if (kind == kTrueColor)
+	{
+		if (!IsColorDepth(header.depth)) { return false; }
+		channels = ChannelsOf(header.depth, header.descriptor);
+	}
+	else
+	{
+		if (header.depth != 8) { return false; }
+		channels = 1;
+	}
+	// a color map may come with any image; only color mapped ones read it
+	size_t mapBytes = header.colorMapType == 1 ? (size_t)header.mapLength * ((header.mapDepth + 7) / 8) : 0;
+	size_t offset = kHeaderSize + header.idLength + mapBytes;
+	if (offset > size) { return false; }
+	int bytes = (header.depth + 7) / 8;
+	size_t count = (size_t)header.width * header.height;
+	if ((unsigned long long)header.width * header.height * 4 > (size_t)-1) { return false; }
+	bool convert = mapped || bytes == 2; // bytes per pixel changes on the way out
+	bool topDown = (header.descriptor & kTopOrigin) != 0;
+
+	// the pixels as the file orders them, still bytes wide each
+	const GLubyte* source = data + offset;
+	if (runLength)
+	{
+		std::vector<GLubyte>& target = convert ? _expanded : _pixels;
+		target.resize(count * bytes);
+		if (!ExpandRuns(data + offset, size - offset, bytes, count, target.data())) { return false; }
+		source = target.data();
+	}
+	else if ((size - offset) / bytes < count)
+	{
+		return false;
+	}
+
+	size_t sourceRow = (size_t)header.width * bytes, row = (size_t)header.width * channels;
+	if (convert)
+	{
+		std::vector<GLubyte> palette;
+		if (mapped)
+		{
+			int mapBytesEach = (header.mapDepth + 7) / 8;
+			const GLubyte* entries = data + offset - mapBytes;
+			palette.resize((size_t)header.mapLength * channels);
+			for (int i = 0; i < header.mapLength; i++)
+			{
+				if (mapBytesEach == 2) { Unpack16(entries + i * 2, &palette[i * channels], channels); }
+				else { memcpy(&palette[i * channels], entries + i * mapBytesEach, channels); }
+			}
+		}
+		_pixels.resize(count * channels);
+		for (int y = 0; y < header.height; y++)
+		{
+			const GLubyte* in = source + y * sourceRow;
+			GLubyte* out = _pixels.data() + (topDown ? header.height - 1 - y : y) * row;
+			for (int x = 0; x < header.width; x++, in += bytes, out += channels)
+			{
+				if (!mapped) { Unpack16(in, out, channels); continue; }
+				// indices outside the map come out black rather than failing the image
+				unsigned index = (unsigned)((bytes == 1 ? in[0] : Word(in)) - header.mapFirst);
+				if (index < (unsigned)header.mapLength) { memcpy(out, &palette[index * channels], channels); }
+				else { memset(out, 0, channels); }
+			}
+		}
+	}
+	else if (runLength)
+	{
+		if (topDown) { FlipRows(_pixels.data(), row, header.height); }
+	}
+	else if (topDown || (header.descriptor & kRightOrigin) != 0)
+	{
+		_pixels.resize(count * channels);
+		for (int y = 0; y < header.height; y++)
+		{
+			memcpy(_pixels.data() + (topDown ? header.height - 1 - y : y) * row, source + y * sourceRow, row);
+		}
+	}
+	else
+	{
+		_data = source;
+	}
+	if (_data == nullptr)
+	{
+		if (header.descriptor & kRightOrigin) { MirrorRows(_pixels.data(), header.width, header.height, channels); }
+		_data = _pixels.data();
+	}
+	_width = header.width;
+	_height = header.height;
+	_channels = channels;
+	return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "gltools.h"
+#include "MappedFile.h"
+// targa reader for every kind of image the format has short of 16 bit gray: uncompressed and
+// run length encoded, true color (15, 16, 24 and 32 bit), color mapped and grayscale, with
+// either origin. the header is read byte by byte, so nothing depends on struct packing.
+// pixels come out packed with their rows bottom up, as glTexImage2D takes them. uncompressed
+// bottom up 24 and 32 bit files are used straight from the mapped file; everything else is
+// decoded into buffers the reader keeps, so one reader used for file after file stops allocating
+class TgaReader
+{
+private:
+	MappedFile _file;
+	std::vector<GLubyte> _pixels;   // the decoded image, unless it is read in place
+	std::vector<GLubyte> _expanded; // run length decoded pixels still to be converted
+	const GLubyte* _data;
+	GLint _width;
+	GLint _height;
+	GLint _channels;
+	TgaReader(const TgaReader&) = delete;
+	TgaReader& operator=(const TgaReader&) = delete;
+public:
+	TgaReader();
+	// false if filename cannot be read or is not a targa the reader handles
+	bool Open(const std::string& filename);
+	// the same for a targa already in memory. data must outlive Pixels, which may point into it
+	bool Decode(const GLubyte* data, size_t size);
+	// unmaps the file, keeping the buffers for the next one
+	void Close();
+	const GLubyte* Pixels() const { return _data; }
+	bool IsInPlace() const { return _data != nullptr && _data != _pixels.data(); }
+	GLint Width() const { return _width; }
+	GLint Height() const { return _height; }
+	GLint Channels() const { return _channels; } // 1, 3 or 4
+	// GL_LUMINANCE, GL_BGR_EXT or GL_BGRA_EXT, and the matching sized internal format
+	GLenum Format() const;
+	GLint InternalFormat() const;
+};
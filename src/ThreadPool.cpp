@@ -0,0 +1,45 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned threadCount)
+{
+	_stopping = false;
+	if (threadCount == 0) { threadCount = std::thread::hardware_concurrency(); }
+	if (threadCount == 0) { threadCount = 2; } // hardware_concurrency may not know
+	for (unsigned i = 0; i < threadCount; i++)
+	{
+		_workers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_wakeUp.notify_all();
+	for (std::thread& worker : _workers)
+	{
+		worker.join();
+	}
+}
+void ThreadPool::WorkerLoop()
+{
+	std::function<void()> task;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wakeUp.wait(lock, [this] { return _stopping || !_tasks.empty(); });
+			// drain the queue before leaving so no future is left dangling
+			if (_tasks.empty()) { return; }
+			task = std::move(_tasks.front());
+			_tasks.pop();
+		}
+		task();
+	}
+}
+ThreadPool& ThreadPool::Shared()
+{
+	static ThreadPool pool;
+	return pool;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <utility>
+// fixed set of worker threads fed from a single FIFO queue.
+// tasks must not block waiting on other tasks of the same pool
+class ThreadPool
+{
+private:
+	std::vector<std::thread> _workers;
+	std::queue<std::function<void()>> _tasks;
+	std::mutex _mutex;
+	std::condition_variable _wakeUp;
+	bool _stopping;
+	void WorkerLoop();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+public:
+	// threadCount 0 uses one worker per hardware thread
+	ThreadPool(unsigned threadCount = 0);
+	~ThreadPool();
+	template <class F>
+	std::future<decltype(std::declval<F&>()())> Submit(F task);
+	unsigned GetThreadCount() { return (unsigned)_workers.size(); }
+	// process-wide pool shared by the loaders
+	static ThreadPool& Shared();
+};
+
+template <class F>
+std::future<decltype(std::declval<F&>()())> ThreadPool::Submit(F task)
+{
+	typedef decltype(task()) Result;
+	std::shared_ptr<std::packaged_task<Result()>> packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+	std::future<Result> result = packaged->get_future();
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_tasks.push([packaged]() { (*packaged)(); });
+	}
+	_wakeUp.notify_one();
+	return result;
+}
@@ -61,6 +61,8 @@
 #else // GLX
 	#define __glext_h_  /* prevent glext.h from being included  */
 	#define __glxext_h_ /* prevent glxext.h from being included */
+	#define GL_GLEXT_LEGACY   /* the same for mesa headers, which guard them by other names */
+	#define GLX_GLXEXT_LEGACY
 	#define GLX_GLXEXT_PROTOTYPES
 	#include <GL/gl.h>
 	#include <GL/glx.h>
@@ -387,8 +387,8 @@ class GLFrame
             M3DMatrix44f invMat;
 			GetMatrix(rotMat, true);
 
-			// Do the rotation based on inverted matrix
-            m3dInvertMatrix44(invMat, rotMat);
+			// Do the rotation based on inverted matrix (rotation only, so transposing it is enough)
+            m3dInvertRigidMatrix44(invMat, rotMat);
 
 			vLocal[0] = invMat[0] * vNewWorld[0] + invMat[4] * vNewWorld[1] + invMat[8] *  vNewWorld[2];	
 			vLocal[1] = invMat[1] * vNewWorld[0] + invMat[5] * vNewWorld[1] + invMat[9] *  vNewWorld[2];	
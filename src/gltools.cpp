@@ -129,7 +129,7 @@ void *gltGetExtensionPointer(const char *szExtensionName)
     return (void *)wglGetProcAddress(szExtensionName);
 #endif
 	
-#ifdef linux
+#ifdef __linux__
     // Pretty much ditto above
     return (void *)glXGetProcAddress((GLubyte *)szExtensionName);
 #endif
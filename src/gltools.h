@@ -35,11 +35,11 @@
 
 #endif
 
-#ifdef linux
-#include "GLee.h"
+#ifdef __linux__
+#include "glee.h"
 #include <GL/gl.h>
 #include <GL/glu.h>
-#include <glut.h>
+#include <GL/glut.h>
 #include <stdlib.h>
 
 // Just ignore sleep in linux too
@@ -47,7 +47,7 @@
 #endif
 
 
-#ifdef linux
+#ifdef __linux__
 typedef GLvoid (*CallBack)();
 #else
 
@@ -1,15 +1,28 @@
 #include <iostream>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#include <future>
+#include <chrono>
+#include <vector>
+#include <algorithm>
 // gl tools
 #include "gltools.h" // OpenGL toolkit
 #include "math3d.h"  // 3D Math Library
 #include "glframe.h" // Frame class
-// opencv
-#include <opencv2/core/core.hpp>
-#include <opencv2/highgui/highgui.hpp>
 // obj reader
 #include "ObjParser.h"
+#include "HeadlessContext.h"
+#include "SceneState.h"
+#include "RenderList.h"
+#include "SpatialGrid.h"
+#include "ActorPool.h"
+#include "MathBench.h"
+#include "MipmapBench.h"
+#include "TgaBench.h"
+#include "DxtBench.h"
+#include "Matrix44.h"
+#include "TextureLoader.h"
 
 typedef unsigned char uchar;
 
@@ -19,15 +32,56 @@ void DrawGround(void);
 void DrawInhabitants(GLint);
 void DisplayFunc(void);
 void SpecialFunc(int, int, int);
+void KeyboardFunc(unsigned char, int, int);
+void MouseFunc(int, int, int, int);
 void IdleFunc(void);
 void TimerFunc(int);
 void ReshapeFunc(int, int);
+int RunHeadless(int);
+void BuildFrame(const SceneState&, RenderList&);
+void UpdateActorBounds(int);
+void GetViewMatrix(RigidMatrix44&);
+
+// set when rendering offscreen with --headless, where there is no window to swap
+bool bHeadless = false;
 
 #define	NUM_BARRELS 30
-GLFrame frameCamera, barrels[NUM_BARRELS], fishes[NUM_BARRELS * 2];
+GLFrame frameCamera;
+// the barrels, and two fishes per barrel (2 * i and 2 * i + 1) circling it
+ActorPool barrels, fishes;
+
+#define BARREL_SCALE 0.05f
+#define FISH_SCALE   0.04f
+// barrel below its frame, and where its two fishes swim at fCosWave 0; the fishes move
+// by (-1, 1, 0) * fCosWave
+const GLfloat fBarrelOffset[3] = { 0.f, -8.f, 0.f };
+const GLfloat fFishOffsets[2][3] = { { 10.f, -2.f, 0.f }, { 8.f, -5.f, 3.f } }; // higher, outer and lower, insider
+const GLfloat fFishSway[3] = { -1.f, 1.f, 0.f };
+const GLfloat fNoSway[3] = { 0.f, 0.f, 0.f };
+// what the current frame draws, built once by BuildFrame and replayed by the shadow and lit passes
+RenderList frameList;
+
+// barrel slots (a barrel and its two fishes) by where they or their shadows can show,
+// queried by BuildFrame and MouseFunc instead of testing every slot
+SpatialGrid actorGrid(4.0f);
+int iActorIds[NUM_BARRELS];
+std::vector<int> actorOfId, visibleActors, visibleFishes;
+
+// animation state, advanced by IdleFunc (or once per frame when headless) and only read while drawing
+SceneState scene;
+int iLastUpdateTime = 0;
 
 // Light and material data
 M3DMatrix44f mShadowMatrix;
+M3DVector4f vGroundPlane; // plane the shadows are projected onto
+
+// projection set by ReshapeFunc, for culling against the view frustum, and its
+// inverse for turning clicks into rays
+GeneralMatrix44 mProjection, mInverseProjection;
+// pixels a length of 1 spans at distance 1 in front of the camera, set by ReshapeFunc for
+// picking levels of detail; --no-lod draws every mesh in full
+GLfloat fPixelsPerUnit = 1.0f;
+bool bLodSelection = true;
 
 GLfloat fLightPos[4] = { -100.0f, 100.0f, 50.0f, 1.0f };  // Point source
 GLfloat fNoLight[] = { 0.0f, 0.0f, 0.0f, 0.0f };
@@ -52,6 +106,18 @@ GLfloat fBackground[] = { 0.f, 0.5f, 0.75f, 1.0f }; // grey-blue background
 
 GLuint textures[TOTAL_TEXTURES];
 const char* szTextureFiles[] = { "./tga/grass.tga", "./tga/wood.tga", "./tga/orb.tga"};
+// what k and g cycle the dolphin's skin and the sea floor through while running
+#define NUM_SKINS  3
+#define NUM_FLOORS 2
+const char* szSkinFiles[NUM_SKINS] = { "./texture/fish1.png", "./texture/dolphin.png", "./texture/fish2.png" };
+const char* szFloorFiles[NUM_FLOORS] = { "./texture/sea.jpg", "./tga/grass.tga" };
+int iSkin = 0, iFloor = 0;
+// decodes on the shared pool and streams the pixels in, at startup and whenever a texture is swapped
+TextureLoader textureLoader;
+// --swap-textures: the headless run swaps both every few frames, to time frames that stream
+bool bSwapTextures = false;
+// --no-texture-compression: upload every texture uncompressed even where gl has S3TC
+bool bTextureCompression = true;
 
 // objs to be used
 ObjParser* dolphin;
@@ -64,28 +130,33 @@ void SetupRC()
 {
     int i, iBarrel;
 	Vec3f offset;
-	GLbyte* pBytes;
-	GLint iWidth, iHeight, iComponents;
-	GLenum eFormat;
-	M3DVector4f pPlane;
 	M3DVector3f vPoints[3] = {
 		{ 0.0f, -0.4f, 0.0f },
         { 10.0f, -0.4f, 0.0f },
         { 5.0f, -0.4f, -5.0f } 
 	};
 
-	// read objs
-	std::cout << "dolphin" << std::endl;
-	dolphin = new ObjParser("./obj/dolphin.obj");
-
-	std::cout << "seaweed" << std::endl;
-	seaweed = new ObjParser("./obj/seaweed.obj");
+	// decode the textures on the shared pool while the objs are read, each on its own
+	// thread (their chunks go to the same pool)
+	textureLoader.SetCompression(bTextureCompression);
+	glGenTextures(TOTAL_TEXTURES, textures); // U@ӤjpNUM_TEXTURES}CopenGLxsAW٬textures
+	for (i = 0; i < NUM_TEXTURES; i++)
+	{
+		textureLoader.Add(textures[i], szTextureFiles[i], GL_CLAMP_TO_EDGE);
+	}
+	textureLoader.Add(textures[GROUND_TEXTURE], szFloorFiles[iFloor], GL_CLAMP);
+	textureLoader.Add(textures[DOLPHIN_TEXTURE], szSkinFiles[iSkin], GL_CLAMP);
+	textureLoader.Add(textures[FISH_TEXTURE], "./texture/black_rect.jpg", GL_CLAMP);
 
-	std::cout << "barrel" << std::endl;
-	barrel = new ObjParser("./obj/barrel.obj");
+	std::future<ObjParser*> dolphinLoad = std::async(std::launch::async, [] { return new ObjParser("./obj/dolphin.obj"); });
+	std::future<ObjParser*> seaweedLoad = std::async(std::launch::async, [] { return new ObjParser("./obj/seaweed.obj"); });
+	std::future<ObjParser*> barrelLoad = std::async(std::launch::async, [] { return new ObjParser("./obj/barrel.obj"); });
+	std::future<ObjParser*> fishLoad = std::async(std::launch::async, [] { return new ObjParser("./obj/fish.obj"); });
 
-	std::cout << "fish" << std::endl;
-	fish = new ObjParser("./obj/fish.obj");
+	dolphin = dolphinLoad.get();
+	seaweed = seaweedLoad.get();
+	barrel = barrelLoad.get();
+	fish = fishLoad.get();
 
     // background color
     glClearColor(fBackground[0], fBackground[1], fBackground[2], fBackground[3]);
@@ -113,8 +184,8 @@ void SetupRC()
     glEnable(GL_LIGHT0);
 
     // Calculate shadow matrix
-    m3dGetPlaneEquation(pPlane, vPoints[0], vPoints[1], vPoints[2]);
-    m3dMakePlanarShadowMatrix(mShadowMatrix, pPlane, fLightPos);
+    m3dGetPlaneEquation(vGroundPlane, vPoints[0], vPoints[1], vPoints[2]);
+    m3dMakePlanarShadowMatrix(mShadowMatrix, vGroundPlane, fLightPos);
 
     // Mostly use material tracking
     glEnable(GL_COLOR_MATERIAL);
@@ -126,12 +197,15 @@ void SetupRC()
 	for (iBarrel = 0; iBarrel < NUM_BARRELS; iBarrel++)
 	{
 		float x, y;
-		x = ((float)((rand() % 400) - 200) * 0.1f);
-		y = ((float)((rand() % 400) - 200) * 0.1f);
+		x = ((float)(scene.Random(400) - 200) * 0.1f);
+		y = ((float)(scene.Random(400) - 200) * 0.1f);
 		// Pick a random location between -20 and 20 at .1 increments
-		barrels[iBarrel].SetOrigin(x, 0.0, y);
-		fishes[iBarrel * 2].SetOrigin(x, 0.0, y); // 0, 2, 4, 6, 8
-		fishes[iBarrel * 2 + 1].SetOrigin(x, 0.0, y); // 1, 3, 5, 7, 9
+		// spin is how many times yRot each turns by
+		barrels.Add(x, 0.0, y, BARREL_SCALE, -2.f, fBarrelOffset, fNoSway);
+		fishes.Add(x, 0.0, y, FISH_SCALE, -1.2f, fFishOffsets[0], fFishSway); // 0, 2, 4, 6, 8
+		fishes.Add(x, 0.0, y, FISH_SCALE, -1.5f, fFishOffsets[1], fFishSway); // 1, 3, 5, 7, 9
+		iActorIds[iBarrel] = -1;
+		UpdateActorBounds(iBarrel);
 	}
 	// direction indicators
 	// barrels[30].SetOrigin( 0.0,  0.5,  0.0); // origin
@@ -143,81 +217,14 @@ void SetupRC()
 
     // Set up texture maps
     glEnable(GL_TEXTURE_2D);
-    glGenTextures(TOTAL_TEXTURES, textures); // U@ӤjpNUM_TEXTURES}CopenGLxsAW٬textures
     glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE); // ]wopenGL课zѼƩM誺զXҦ
-
-    for (i = 0; i < NUM_TEXTURES; i++)
-    {
-        glBindTexture(GL_TEXTURE_2D, textures[i]);
-
-        // Load this texture map
-        pBytes = gltLoadTGA(szTextureFiles[i], &iWidth, &iHeight, &iComponents, &eFormat);
-        gluBuild2DMipmaps(GL_TEXTURE_2D, iComponents, iWidth, iHeight, eFormat, GL_UNSIGNED_BYTE, pBytes);
-        free(pBytes);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    }
-
-	// Load the texture objects
-	cv::Mat seaImage = cv::imread("./texture/sea.jpg"); // QopenCVŪϤɮ
-	if (seaImage.empty()) {
-		std::cout << "Sea floor empty\n";
-	}
-	else {
-		// NŪiӪϤɮ׷@sitextures
-		cv::flip(seaImage, seaImage, 0);
-		//glGenTextures(1, &textures[3]);
-		glBindTexture(GL_TEXTURE_2D, textures[3]);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, seaImage.cols, seaImage.rows, 0, GL_BGR_EXT, GL_UNSIGNED_BYTE, seaImage.ptr());
-	}
-
-	cv::Mat fishImage_1 = cv::imread("./texture/fish1.png");
-	if (fishImage_1.empty()) {
-		std::cout << "Fish1 skin empty\n";
-	}
-	else {
-		// NŪiӪϤɮ׷@sitextures
-		cv::flip(fishImage_1, fishImage_1, 0);
-		glBindTexture(GL_TEXTURE_2D, textures[4]);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, fishImage_1.cols, fishImage_1.rows, 0, GL_BGR_EXT, GL_UNSIGNED_BYTE, fishImage_1.ptr());
-	}
-
-	cv::Mat fishImage_2 = cv::imread("./texture/black_rect.jpg");
-	if (fishImage_2.empty()) {
-		std::cout << "Fish2 skin empty\n";
-	}
-	else {
-		// NŪiӪϤɮ׷@sitextures
-		cv::flip(fishImage_2, fishImage_2, 0);
-		glBindTexture(GL_TEXTURE_2D, textures[5]);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, fishImage_2.cols, fishImage_2.rows, 0, GL_BGR_EXT, GL_UNSIGNED_BYTE, fishImage_2.ptr());
-	}
+	textureLoader.UploadAll();
 }
 
 // Do shutdown for the rendering context
 void ShutdownRC(void)
 {
+	textureLoader.Release();
 	glDeleteTextures(TOTAL_TEXTURES, textures); // Delete the textures
 }
 
@@ -259,158 +266,154 @@ void DrawGround(void)
 	}
 }
 
-void DrawCustom(GLint nShadow)
+// glScalef(scale) * glRotatef(angle, 0, 1, 0) * glTranslatef(x, y, z) in one matrix
+void GetLocalMatrix(M3DMatrix44f matrix, GLfloat scale, GLfloat angle, GLfloat x, GLfloat y, GLfloat z)
 {
-	float ratio;
-	GLint i;
-	static GLfloat yRot = 0.0f; // Rotation angle for animation
-	// fish cos-wave
-	GLfloat fCosWave;
-	static int factor = 1; // need to be static since it flips
-	static int cosWave = 0; // move portion
-	static int counter = 0;
-	// dolphin moves
-	static GLfloat dx = 0.0f;
-	static GLfloat dy = 0.0f;
-	static GLfloat dz = 0.0f;
-	static GLfloat dRot = 0.0f;
-	static bool stop = false;
-	static int moveCounter = 0;
-
-	if (nShadow == 0)
-	{
-		yRot += 0.5f;
-		if (stop) { dRot += 0.5f; }
-		glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-	}
-	else // Shadow color
+	int i;
+
+	m3dRotationMatrix44(matrix, (float)m3dDegToRad(angle), 0.0f, 1.0f, 0.0f);
+	matrix[12] = matrix[0] * x + matrix[4] * y + matrix[8] * z;
+	matrix[13] = matrix[1] * x + matrix[5] * y + matrix[9] * z;
+	matrix[14] = matrix[2] * x + matrix[6] * y + matrix[10] * z;
+	for (i = 0; i < 16; i++)
 	{
-		glColor4f(0.00f, 0.00f, 0.00f, .6f);
+		if (i % 4 != 3) { matrix[i] *= scale; } // leave the bottom row alone
 	}
+}
 
-	// Draw the randomly located barrels (Object_A) and fishes (Object_B)
-	for (i = 0; i < NUM_BARRELS; i++)
+// Sphere around everything barrel slot i can draw over the whole animation, merged with the
+// shadow it casts, kept in actorGrid. Call again whenever the barrel moves
+void UpdateActorBounds(int i)
+{
+	Vec3f center;
+	float radius, reach;
+	int j;
+	M3DVector3f vOrigin, vOffset, vSway;
+	GLfloat sphere[4], shadow[4];
+
+	// rotation keeps lengths, so a mesh stays within scale * (|offset| + |sway| + |center| + radius)
+	// of its frame's origin while the cos-wave runs between -1 and 1
+	barrel->GetBoundingSphere(center, radius);
+	barrels.GetOffset(i, vOffset);
+	barrels.GetSway(i, vSway);
+	reach = barrels.GetScale(i) * (m3dGetVectorLength(vOffset) + m3dGetVectorLength(vSway) +
+		sqrtf(center.x * center.x + center.y * center.y + center.z * center.z) + radius);
+	fish->GetBoundingSphere(center, radius);
+	for (j = i * 2; j < i * 2 + 2; j++)
 	{
-		ratio = 0.05f;
-	
-		glBindTexture(GL_TEXTURE_2D, textures[BARREL_TEXTURE]);
-		glPushMatrix(); // barrel
-		{
-			barrels[i].ApplyActorTransform();
-			glScalef(ratio, ratio, ratio);
-			glRotatef(-yRot * 2, 0.0f, 1.0f, 0.0f);
-			glTranslatef(0.f, -8.f, 0.f);
-			barrel->Draw(GL_TRIANGLES, true);
-		}
-		glPopMatrix();
-
-		// if (i >= NUM_BARRELS - 6) { continue; } // indicators wont have fishes
+		fishes.GetOffset(j, vOffset);
+		fishes.GetSway(j, vSway);
+		reach = std::max(reach, fishes.GetScale(j) * (m3dGetVectorLength(vOffset) + m3dGetVectorLength(vSway) +
+			sqrtf(center.x * center.x + center.y * center.y + center.z * center.z) + radius));
+	}
 
-		ratio = 0.04f;
-		fCosWave = ((float)cosWave) / 10.0f;
+	barrels.GetOrigin(i, vOrigin);
+	sphere[0] = vOrigin[0];
+	sphere[1] = vOrigin[1];
+	sphere[2] = vOrigin[2];
+	sphere[3] = reach;
+	if (GetShadowSphere(vGroundPlane, fLightPos, sphere, shadow)) { MergeSpheres(sphere, shadow, sphere); }
+	else { sphere[3] = kUnboundedRadius; } // shadow without bound, always drawn
 
-		glBindTexture(GL_TEXTURE_2D, textures[FISH_TEXTURE]);
-		glPushMatrix(); // fish 1
-		{
-			fishes[i * 2].ApplyActorTransform();
-			glScalef(ratio, ratio, ratio);
-			glRotatef(-yRot * 1.2, 0.0f, 1.0f, 0.0f);
-			glTranslatef(10.f - fCosWave, -2.f + fCosWave, 0.f); // higher, outer
-			fish->Draw(GL_TRIANGLES, true);
-		}
-		glPopMatrix();
-
-		glPushMatrix(); // fish 2
-		{
-			fishes[i * 2 + 1].ApplyActorTransform();
-			glScalef(ratio, ratio, ratio);
-			glRotatef(-yRot * 1.5, 0.0f, 1.0f, 0.0f);
-			glTranslatef(8.f - fCosWave, -5.f + fCosWave, 3.f); // lower, insider
-			fish->Draw(GL_TRIANGLES, true);
-		}
-		glPopMatrix();
+	if (iActorIds[i] < 0)
+	{
+		iActorIds[i] = actorGrid.Insert(sphere[0], sphere[1], sphere[2], sphere[3]);
+		if ((int)actorOfId.size() <= iActorIds[i]) { actorOfId.resize(iActorIds[i] + 1); }
+		actorOfId[iActorIds[i]] = i;
 	}
-
-	// Draw the dolphin (Object_C) swim around seaweed. Stop will last for a full round, 
-	glPushMatrix();
+	else
 	{
-		ratio = 0.005f;
-		glScalef(ratio, ratio, ratio);
-
-		glTranslatef(0.0f, 20.f, -500.f);
-		glRotatef((yRot - dRot) * 2, 0.0f, 1.0f, 0.0f); // if stop, dolphin stays
-		glTranslatef(200.f + dx, 0.f + dy, 0.f + dz);
-
-		glBindTexture(GL_TEXTURE_2D, textures[DOLPHIN_TEXTURE]);
-		dolphin->Draw(GL_TRIANGLES, true);
+		actorGrid.Update(iActorIds[i], sphere[0], sphere[1], sphere[2], sphere[3]);
 	}
-	glPopMatrix();
+}
 
-	// Draw the seaweed
-	glPushMatrix(); // no texture for this obj
-	{
-		ratio = 0.1f;
-		glScalef(ratio, ratio, ratio);
+// What ApplyCameraTransform loads: the camera orientation, then the origin moved to the eye
+void GetViewMatrix(RigidMatrix44& mView)
+{
+	M3DVector3f vEye;
 
-		glTranslatef(-1.f, -4.3f, 0.f);
-		//glTranslatef(-1.f, -4.3f, 23.f); // to origin
-		//glRotatef(yRot, 0.0f, 1.0f, 0.0f); // rotate along y-axis
-		//glTranslatef(0.f, 0.f, -20.f); // to dest
+	frameCamera.GetOrigin(vEye);
+	frameCamera.GetCameraOrientation(mView);
+	mView[12] = -(mView[0] * vEye[0] + mView[4] * vEye[1] + mView[8] * vEye[2]);
+	mView[13] = -(mView[1] * vEye[0] + mView[5] * vEye[1] + mView[9] * vEye[2]);
+	mView[14] = -(mView[2] * vEye[0] + mView[6] * vEye[1] + mView[10] * vEye[2]);
+}
 
-		if (nShadow == 0) 
-		{
-			glColorMaterial(GL_FRONT, GL_SPECULAR);
-			glMaterialfv(GL_FRONT, GL_SPECULAR, fNoLight);
-			glColor4f(0.f, 1.f, 0.f, 1.f); // set seaweed to green
-		}
-		seaweed->Draw(GL_TRIANGLES, false);
-	}
-	glPopMatrix();
+// Walk the scene once and record every draw of the frame with its world matrix
+void BuildFrame(const SceneState& state, RenderList& list)
+{
+	float ratio;
+	size_t k;
+	GLsizei count;
+	GLfloat yRot = state.yRot; // Rotation angle for animation
+	GLfloat fCosWave = state.GetCosWave(); // fish cos-wave
+	GLfloat fWhite[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	GLfloat fGreen[] = { 0.0f, 1.0f, 0.0f, 1.0f };
+	GLfloat* barrelMatrices;
+	GLfloat* fishMatrices;
+	GLfloat* matrix;
+	M3DVector3f vEye, vForward;
+	RigidMatrix44 mView;
+	Frustum frustum;
+
+	list.Clear();
+	frameCamera.GetOrigin(vEye);
+	frameCamera.GetForwardVector(vForward);
+	GetViewMatrix(mView);
+	frustum.Extract(mProjection, mView);
+
+	// Only the barrel slots the grid finds in view, kept in slot order
+	actorGrid.QueryFrustum(frustum, visibleActors);
+	for (k = 0; k < visibleActors.size(); k++) { visibleActors[k] = actorOfId[visibleActors[k]]; }
+	std::sort(visibleActors.begin(), visibleActors.end());
+	count = (GLsizei)visibleActors.size();
+	list.CountCulled((NUM_BARRELS - count) * 3);
 
-	if (nShadow != 0) { return; }
-	
-	if (counter++ >= 5)
+	// Draw the randomly located barrels (Object_A) and fishes (Object_B)
+	barrelMatrices = list.Add(barrel, textures[BARREL_TEXTURE], true, fWhite, kMaterialDefault, count);
+	barrels.BuildMatrices(visibleActors.data(), visibleActors.size(), yRot, fCosWave, barrelMatrices);
+	visibleFishes.clear();
+	for (k = 0; k < visibleActors.size(); k++)
 	{
-		// reset counter
-		counter = 0;
-		// update swim counter
-		moveCounter++;
-		// update fishes cos-wave
-		factor = (cosWave >= 10 || cosWave <= -10) ? -factor : factor;
-		cosWave += factor;
-		cosWave = std::min(10, std::max(-10, cosWave));
-		fCosWave = ((float)cosWave) / 10.0f;
-		//std::cout << "cosWave: " << cosWave << " factor: " << factor << std::endl; // debug
-		//std::cout << "fCosWave: " << fCosWave << std::endl; // debug
+		// if (i >= NUM_BARRELS - 6) { continue; } // indicators wont have fishes
+		visibleFishes.push_back(visibleActors[k] * 2);
+		visibleFishes.push_back(visibleActors[k] * 2 + 1);
 	}
+	fishMatrices = list.Add(fish, textures[FISH_TEXTURE], true, fWhite, kMaterialDefault, count * 2);
+	fishes.BuildMatrices(visibleFishes.data(), visibleFishes.size(), yRot, fCosWave, fishMatrices);
 
-	if (moveCounter >= 20)
-	{
-		// reset swim counter
-		moveCounter = 0;
-		// check if dolphin need to stop
-		if (stop == true && dRot >= 180) { stop = false; } // unfreeze dolphin after stopped for a round
-		else if (stop == false) { stop = (rand() % 2 == 1); }
-		std::cout << "stop: " << stop << " dRot: " << dRot << std::endl; // debug
-
-		if (!stop)
-		{
-			dRot = 0.0f; // reset dRot for next time
-			GLfloat threshold = 20.0f;
-			dx += ((float)(rand() % 3) - 1.0f) * 2; // 0, 1, 2 --> -1, 0, 1
-			dy += ((float)(rand() % 3) - 1.0f) * 2;
-			dz += ((float)(rand() % 3) - 1.0f) * 2;
-			dx = std::min(threshold, std::max(-threshold, dx));
-			dy = std::min(threshold, std::max(-threshold, dy));
-			dz = std::min(threshold, std::max(-threshold, dz));
-			//std::cout << "dx: " << dx << " dy: " << dy << " dz: " << dz << std::endl; // debug
-		}
-	}
+	// Draw the dolphin (Object_C) swim around seaweed. Stop will last for a full round, 
+	// scale * translate(0, 20, -500) * rotate * translate(200 + dx, dy, dz)
+	ratio = 0.005f;
+	matrix = list.Add(dolphin, textures[DOLPHIN_TEXTURE], true, fWhite, kMaterialDefault, 1);
+	GetLocalMatrix(matrix, ratio, (yRot - state.dRot) * 2, 200.f + state.dx, 0.f + state.dy, 0.f + state.dz); // if stop, dolphin stays
+	matrix[13] += 20.f * ratio;
+	matrix[14] += -500.f * ratio;
+
+	// Draw the seaweed, no texture for this obj and no specular highlight
+	ratio = 0.1f;
+	matrix = list.Add(seaweed, 0, false, fGreen, kMaterialMatte, 1);
+	GetLocalMatrix(matrix, ratio, 0.0f, -1.f, -4.3f, 0.f);
+	//glTranslatef(-1.f, -4.3f, 23.f); // to origin
+	//glRotatef(yRot, 0.0f, 1.0f, 0.0f); // rotate along y-axis
+	//glTranslatef(0.f, 0.f, -20.f); // to dest
+
+	// Drop each instance that is out of view along with its shadow
+	list.Cull(frustum, vGroundPlane, fLightPos);
+
+	// Coarser meshes for what is far enough away not to tell the difference
+	if (bLodSelection) { list.SelectLods(vEye, fPixelsPerUnit); }
+
+	// Fewest state changes first, then front to back
+	list.Sort(vEye, vForward);
 }
 
 // Called to draw scene
 void DisplayFunc(void)
 {
+	textureLoader.Update(); // swapped textures, without waiting on them
+	BuildFrame(scene, frameList);
+
 	// Clear the window with current clearing color
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 	glShadeModel(GL_SMOOTH);
@@ -438,7 +441,8 @@ void DisplayFunc(void)
 		glPushMatrix();
 		{
 			glMultMatrixf(mShadowMatrix);
-			DrawCustom(1); // Draw shadow
+			glColor4f(0.00f, 0.00f, 0.00f, .6f); // Shadow color
+			frameList.Draw(true); // Draw shadow
 		}
 		glPopMatrix();
 
@@ -449,11 +453,11 @@ void DisplayFunc(void)
 		glEnable(GL_TEXTURE_2D);
 		glEnable(GL_DEPTH_TEST);
 
-		DrawCustom(0); // Draw normally
+		frameList.Draw(false); // Draw normally
 	}
 	glPopMatrix();
 
-	glutSwapBuffers(); // Do the buffer Swap
+	if (!bHeadless) { glutSwapBuffers(); } // Do the buffer Swap
 }
 
 // Respond to arrow keys by moving the camera frame of reference
@@ -470,8 +474,57 @@ void SpecialFunc(int key, int x, int y)
     glutPostRedisplay(); // Refresh the Window
 }
 
+// k and g swap the dolphin's skin and the sea floor; the old one shows until the new one is in
+void KeyboardFunc(unsigned char key, int x, int y)
+{
+	if (key == 'k')
+	{
+		iSkin = (iSkin + 1) % NUM_SKINS;
+		textureLoader.Add(textures[DOLPHIN_TEXTURE], szSkinFiles[iSkin], GL_CLAMP);
+	}
+	if (key == 'g')
+	{
+		iFloor = (iFloor + 1) % NUM_FLOORS;
+		textureLoader.Add(textures[GROUND_TEXTURE], szFloorFiles[iFloor], GL_CLAMP);
+	}
+}
+
+// Left click names the barrel slot whose bounds are under the cursor
+void MouseFunc(int button, int state, int x, int y)
+{
+	GLint viewport[4];
+	RigidMatrix44 mView;
+	M3DVector4f nearPoint, farPoint;
+	GLfloat origin[3], direction[3], distance;
+	int i, id;
+
+	if (button != GLUT_LEFT_BUTTON || state != GLUT_DOWN) { return; }
+
+	// what gluUnProject does, but with the view undone by its rigid inverse instead of
+	// inverting projection * view as a general matrix on every click
+	GetViewMatrix(mView);
+	GeneralMatrix44 mUnproject = Inverse(mView) * mInverseProjection;
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	M3DVector4f vNear = { 2.0f * (x - viewport[0]) / viewport[2] - 1.0f, 2.0f * (viewport[3] - y - viewport[1]) / viewport[3] - 1.0f, -1.0f, 1.0f };
+	M3DVector4f vFar = { vNear[0], vNear[1], 1.0f, 1.0f };
+	m3dTransformVector4(nearPoint, vNear, mUnproject);
+	m3dTransformVector4(farPoint, vFar, mUnproject);
+	for (i = 0; i < 3; i++)
+	{
+		origin[i] = nearPoint[i] / nearPoint[3];
+		direction[i] = farPoint[i] / farPoint[3] - origin[i];
+	}
+
+	id = actorGrid.Raycast(origin, direction, m3dGetVectorLength(direction), &distance);
+	if (id >= 0) { std::cout << "picked barrel " << actorOfId[id] << " at " << distance << std::endl; }
+}
+
 void IdleFunc(void)
 {
+	// advance the animation by the real time since the last call, in fixed ticks
+	int now = glutGet(GLUT_ELAPSED_TIME);
+	scene.Update((now - iLastUpdateTime) / 1000.0);
+	iLastUpdateTime = now;
 	glutPostRedisplay();
 }
 
@@ -499,22 +552,131 @@ void ReshapeFunc(int w, int h)
 
     // Set the clipping volume
     gluPerspective(35.0f, fAspect, 1.0f, 50.0f);
+    glGetFloatv(GL_PROJECTION_MATRIX, mProjection);
+    Invert(mProjection, mInverseProjection);
+    fPixelsPerUnit = mProjection.m[5] * h / 2.0f;
 
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
 }
 
+// Renders frames of DisplayFunc into an offscreen context and reports how long each took.
+// cpu is the time spent issuing the frame, gl the wait in glFinish until it is drawn;
+// wall clock rather than timer queries, which llvmpipe does not report reliably
+int RunHeadless(int frames)
+{
+	const int width = 800, height = 600;
+	HeadlessContext context;
+	if (!context.Create(width, height)) { return 1; }
+	bHeadless = true;
+
+	SetupRC();
+	ReshapeFunc(width, height);
+	std::cout << "headless: " << glGetString(GL_RENDERER) << ", " << width << "x" << height << ", " << frames << " frames" << std::endl;
+
+	std::vector<double> cpuTimes, glTimes;
+	unsigned stateRequested = 0, stateIssued = 0, instancesDrawn = 0, instancesCulled = 0;
+	double triangles = 0, fullTriangles = 0;
+	for (int i = 0; i < frames; i++)
+	{
+		scene.Step(); // one tick per frame, so runs are repeatable
+		if (bSwapTextures && i % 10 == 5)
+		{
+			KeyboardFunc('k', 0, 0);
+			KeyboardFunc('g', 0, 0);
+		}
+		auto start = std::chrono::steady_clock::now();
+		DisplayFunc();
+		auto issued = std::chrono::steady_clock::now();
+		glFinish();
+		auto finished = std::chrono::steady_clock::now();
+
+		double cpuTime = std::chrono::duration<double, std::milli>(issued - start).count();
+		double glTime = std::chrono::duration<double, std::milli>(finished - issued).count();
+		stateRequested += frameList.GetStats().requested;
+		stateIssued += frameList.GetStats().issued;
+		instancesDrawn += frameList.GetStats().drawnInstances;
+		instancesCulled += frameList.GetStats().culledInstances;
+		triangles += frameList.GetStats().triangles;
+		fullTriangles += frameList.GetStats().fullTriangles;
+		cpuTimes.push_back(cpuTime);
+		glTimes.push_back(glTime);
+		std::cout << "frame " << i << ": cpu " << cpuTime << " ms, gl " << glTime << " ms" << std::endl;
+	}
+	ShutdownRC();
+
+	// min / median / mean / max per column, for comparing runs
+	auto summarize = [](const char* name, std::vector<double> times)
+	{
+		std::sort(times.begin(), times.end());
+		double total = 0;
+		for (double t : times) { total += t; }
+		std::cout << "headless " << name << " ms: min " << times.front() << ", median " << times[times.size() / 2]
+			<< ", mean " << total / times.size() << ", max " << times.back() << std::endl;
+	};
+	summarize("cpu", cpuTimes);
+	summarize("gl", glTimes);
+	std::cout << "headless state changes per frame: " << (double)stateIssued / frames << " issued of "
+		<< (double)stateRequested / frames << " requested, " << (double)(stateRequested - stateIssued) / frames << " eliminated" << std::endl;
+	std::cout << "headless instances per frame: " << (double)instancesDrawn / frames << " drawn, "
+		<< (double)instancesCulled / frames << " culled" << std::endl;
+	std::cout << "headless triangles per frame (shadow and lit passes): " << triangles / frames << " submitted, "
+		<< fullTriangles / frames << " without lod selection" << std::endl;
+	return 0;
+}
+
 int main(int argc, char* argv[])
 {
+	// --headless [frames]: no window, render offscreen and print frame timings
+	for (int i = 1; i < argc; i++)
+	{
+		// --no-lod: full meshes everywhere, for comparing against lod selection
+		if (strcmp(argv[i], "--no-lod") == 0) { bLodSelection = false; }
+		if (strcmp(argv[i], "--swap-textures") == 0) { bSwapTextures = true; }
+		if (strcmp(argv[i], "--no-texture-compression") == 0) { bTextureCompression = false; }
+		if (strcmp(argv[i], "--headless") == 0)
+		{
+			int frames = (i + 1 < argc) ? atoi(argv[i + 1]) : 0;
+			return RunHeadless(frames > 0 ? frames : 100);
+		}
+		// --bench-math [repeats]: time the batched math3d kernels against the single calls
+		if (strcmp(argv[i], "--bench-math") == 0)
+		{
+			int repeats = (i + 1 < argc) ? atoi(argv[i + 1]) : 0;
+			return RunMathBenchmark(repeats > 0 ? repeats : 20);
+		}
+		// --bench-mipmaps [repeats]: time the mip chain builder against gluBuild2DMipmaps
+		if (strcmp(argv[i], "--bench-mipmaps") == 0)
+		{
+			int repeats = (i + 1 < argc) ? atoi(argv[i + 1]) : 0;
+			return RunMipmapBenchmark(repeats > 0 ? repeats : 5);
+		}
+		// --bench-tga [repeats]: time the targa reader against gltLoadTGA and on every kind of targa
+		if (strcmp(argv[i], "--bench-tga") == 0)
+		{
+			int repeats = (i + 1 < argc) ? atoi(argv[i + 1]) : 0;
+			return RunTgaBenchmark(repeats > 0 ? repeats : 20);
+		}
+		// --bench-dxt [repeats]: time the S3TC texture cache against decoding the images
+		if (strcmp(argv[i], "--bench-dxt") == 0)
+		{
+			int repeats = (i + 1 < argc) ? atoi(argv[i + 1]) : 0;
+			return RunDxtBenchmark(repeats > 0 ? repeats : 3);
+		}
+	}
+
 	glutInit(&argc, argv);
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH | GLUT_STENCIL);
 	glutInitWindowSize(800, 600);
 	glutCreateWindow("110AEM002 Final Project OpenGL (Ocean)");
 	glutReshapeFunc(ReshapeFunc);
 	glutSpecialFunc(SpecialFunc);
+	glutKeyboardFunc(KeyboardFunc);
+	glutMouseFunc(MouseFunc);
 	glutDisplayFunc(DisplayFunc);
 
 	SetupRC();
+	iLastUpdateTime = glutGet(GLUT_ELAPSED_TIME); // don't count loading as animation time
 	glutIdleFunc(IdleFunc);
 	glutTimerFunc(33, TimerFunc, 0);
 
@@ -501,6 +501,85 @@ bool m3dInvertMatrix44(M3DMatrix44f dst, const M3DMatrix44f src )
 	}
 
 
+///////////////////////////////////////////////////////////////////////////////
+// Inverse of a rotation and translation: transpose the rotation, then
+// rotate the negated translation by it
+void m3dInvertRigidMatrix44(M3DMatrix44f dst, const M3DMatrix44f src)
+	{
+	float tx = src[12], ty = src[13], tz = src[14];
+	M3DMatrix44f inv;	// src and dst may be the same matrix
+
+	inv[0] = src[0];	inv[4] = src[1];	inv[8] = src[2];
+	inv[1] = src[4];	inv[5] = src[5];	inv[9] = src[6];
+	inv[2] = src[8];	inv[6] = src[9];	inv[10] = src[10];
+
+	inv[12] = -(inv[0] * tx + inv[4] * ty + inv[8] * tz);
+	inv[13] = -(inv[1] * tx + inv[5] * ty + inv[9] * tz);
+	inv[14] = -(inv[2] * tx + inv[6] * ty + inv[10] * tz);
+	inv[3] = inv[7] = inv[11] = 0.0f;
+	inv[15] = 1.0f;
+
+	m3dCopyMatrix44(dst, inv);
+	}
+
+///////////////////////////////////////////////////////////////////////////////
+// Inverse of a 3x3 plus translation: the 3x3 part by its adjugate over the
+// determinant, then the negated translation through it
+bool m3dInvertAffineMatrix44(M3DMatrix44f dst, const M3DMatrix44f src)
+	{
+	#define MAT(m,r,c) (m)[(c)*4+(r)]
+	float c00 = MAT(src,1,1) * MAT(src,2,2) - MAT(src,1,2) * MAT(src,2,1);
+	float c01 = MAT(src,1,2) * MAT(src,2,0) - MAT(src,1,0) * MAT(src,2,2);
+	float c02 = MAT(src,1,0) * MAT(src,2,1) - MAT(src,1,1) * MAT(src,2,0);
+	float det = MAT(src,0,0) * c00 + MAT(src,0,1) * c01 + MAT(src,0,2) * c02;
+	if (0.0f == det) return false;
+
+	float s = 1.0f / det;
+	float tx = MAT(src,0,3), ty = MAT(src,1,3), tz = MAT(src,2,3);
+	M3DMatrix44f inv;	// src and dst may be the same matrix
+
+	MAT(inv,0,0) = c00 * s;
+	MAT(inv,1,0) = c01 * s;
+	MAT(inv,2,0) = c02 * s;
+	MAT(inv,0,1) = (MAT(src,0,2) * MAT(src,2,1) - MAT(src,0,1) * MAT(src,2,2)) * s;
+	MAT(inv,1,1) = (MAT(src,0,0) * MAT(src,2,2) - MAT(src,0,2) * MAT(src,2,0)) * s;
+	MAT(inv,2,1) = (MAT(src,0,1) * MAT(src,2,0) - MAT(src,0,0) * MAT(src,2,1)) * s;
+	MAT(inv,0,2) = (MAT(src,0,1) * MAT(src,1,2) - MAT(src,0,2) * MAT(src,1,1)) * s;
+	MAT(inv,1,2) = (MAT(src,0,2) * MAT(src,1,0) - MAT(src,0,0) * MAT(src,1,2)) * s;
+	MAT(inv,2,2) = (MAT(src,0,0) * MAT(src,1,1) - MAT(src,0,1) * MAT(src,1,0)) * s;
+
+	MAT(inv,0,3) = -(MAT(inv,0,0) * tx + MAT(inv,0,1) * ty + MAT(inv,0,2) * tz);
+	MAT(inv,1,3) = -(MAT(inv,1,0) * tx + MAT(inv,1,1) * ty + MAT(inv,1,2) * tz);
+	MAT(inv,2,3) = -(MAT(inv,2,0) * tx + MAT(inv,2,1) * ty + MAT(inv,2,2) * tz);
+	MAT(inv,3,0) = MAT(inv,3,1) = MAT(inv,3,2) = 0.0f;
+	MAT(inv,3,3) = 1.0f;
+
+	m3dCopyMatrix44(dst, inv);
+	return true;
+	#undef MAT
+	}
+
+///////////////////////////////////////////////////////////////////////////////
+// Product of two affine matricies; the bottom row is always 0 0 0 1
+void m3dMatrixMultiplyAffine44(M3DMatrix44f product, const M3DMatrix44f a, const M3DMatrix44f b)
+	{
+	#define A(row,col)  a[(col<<2)+row]
+	#define B(row,col)  b[(col<<2)+row]
+	#define P(row,col)  product[(col<<2)+row]
+	for (int i = 0; i < 3; i++) {
+		float ai0=A(i,0),  ai1=A(i,1),  ai2=A(i,2),  ai3=A(i,3);
+		P(i,0) = ai0 * B(0,0) + ai1 * B(1,0) + ai2 * B(2,0);
+		P(i,1) = ai0 * B(0,1) + ai1 * B(1,1) + ai2 * B(2,1);
+		P(i,2) = ai0 * B(0,2) + ai1 * B(1,2) + ai2 * B(2,2);
+		P(i,3) = ai0 * B(0,3) + ai1 * B(1,3) + ai2 * B(2,3) + ai3;
+	}
+	P(3,0) = P(3,1) = P(3,2) = 0.0f;
+	P(3,3) = 1.0f;
+	#undef A
+	#undef B
+	#undef P
+	}
+
 // Ditto above, but for doubles
 bool m3dInvertMatrix44(M3DMatrix44d dst, const M3DMatrix44d src)
 	{
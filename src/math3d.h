@@ -529,6 +529,17 @@ inline void m3dTransposeMatrix44(M3DMatrix44d dst, const M3DMatrix44d src)
 bool m3dInvertMatrix44(M3DMatrix44f dst, const M3DMatrix44f src);
 bool m3dInvertMatrix44(M3DMatrix44d dst, const M3DMatrix44d src);
 
+// Cheaper inverses when more is known about the matrix. Only floating point
+// implementations are provided.
+// Rigid: rotation plus translation only (GLFrame::GetMatrix, a view matrix).
+// The inverse is the transposed rotation and the translation rotated back.
+void m3dInvertRigidMatrix44(M3DMatrix44f dst, const M3DMatrix44f src);
+// Affine: any 3x3 (scale, shear) plus translation, bottom row 0 0 0 1. Fails
+// like m3dInvertMatrix44 when the 3x3 part is singular.
+bool m3dInvertAffineMatrix44(M3DMatrix44f dst, const M3DMatrix44f src);
+// m3dMatrixMultiply44 for two affine matrices, skipping the bottom row
+void m3dMatrixMultiplyAffine44(M3DMatrix44f product, const M3DMatrix44f a, const M3DMatrix44f b);
+
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
@@ -606,5 +617,28 @@ double m3dClosestPointOnRay(M3DVector3d vPointOnRay, const M3DVector3d vRayOrigi
 float m3dClosestPointOnRay(M3DVector3f vPointOnRay, const M3DVector3f vRayOrigin, const M3DVector3f vUnitRayDir, 
 							const M3DVector3f vPointInSpace);
 
-#endif
+/////////////////////////////////////////////////////////////////////////////
+// Batched kernels, implemented in math3dBatch.cpp
+// Same results as calling the single versions in a loop (bit for bit, no fused
+// multiply-add), but run with SSE2 or AVX2 when the CPU has it. The widest level
+// the CPU supports is picked with CPUID on first use; other CPUs use a scalar loop.
+enum M3DSimdLevel { M3D_SIMD_SCALAR, M3D_SIMD_SSE2, M3D_SIMD_AVX2 };
+
+M3DSimdLevel m3dGetSimdLevel(void);
+// Forces a lower level (clamped to what the CPU supports), for benchmarks and
+// comparisons. Not thread safe; call it before the kernels are in use.
+void m3dSetSimdLevel(M3DSimdLevel level);
+const char* m3dGetSimdLevelName(M3DSimdLevel level);
 
+// products[i] = a[i] * b[i] for count matrices stored back to back (16 floats each).
+// With aStride 0, a is one matrix applied to every b[i] (a parent or view matrix).
+void m3dMatrixMultiply44Batch(float* products, const float* a, size_t aStride, const float* b, size_t count);
+
+// m3dTransformVector3 for count points stored back to back (3 floats each). vOut may be v.
+void m3dTransformVector3Batch(float* vOut, const float* v, const M3DMatrix44f m, size_t count);
+
+// m3dFindNormal for count triangles of an indexed mesh: indices holds three
+// vertex indices per triangle into points (3 floats each), result one normal per triangle
+void m3dFindNormalBatch(float* result, const float* points, const unsigned int* indices, size_t count);
+
+#endif
@@ -0,0 +1,279 @@
+// Batched versions of the math3d matrix and vector routines, with SSE2 and AVX2
+// kernels picked at run time. Every kernel does the same multiplies and adds in
+// the same order as the scalar code, so the results match it bit for bit.
+#include "math3d.h"
+#include <stddef.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define M3D_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC compiles any intrinsic without an /arch switch
+#define M3D_TARGET(isa)
+#else
+// gcc and clang only allow wider intrinsics in functions marked for them
+#define M3D_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace
+{
+	typedef void (*MultiplyKernel)(float*, const float*, size_t, const float*, size_t);
+	typedef void (*TransformKernel)(float*, const float*, const float*, size_t);
+	typedef void (*NormalKernel)(float*, const float*, const unsigned int*, size_t);
+
+	struct Kernels
+	{
+		M3DSimdLevel level;
+		MultiplyKernel multiply;
+		TransformKernel transform;
+		NormalKernel normal;
+	};
+
+	// scalar kernels, also used for the tails the vector kernels leave over
+
+	void MultiplyScalar(float* products, const float* a, size_t aStride, const float* b, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			m3dMatrixMultiply44(products + i * 16, a + i * aStride, b + i * 16);
+		}
+	}
+	void TransformScalar(float* vOut, const float* v, const float* m, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			M3DVector3f point = { v[i * 3], v[i * 3 + 1], v[i * 3 + 2] }; // vOut may alias v
+			m3dTransformVector3(vOut + i * 3, point, m);
+		}
+	}
+	void NormalScalar(float* result, const float* points, const unsigned int* indices, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			m3dFindNormal(result + i * 3, points + indices[i * 3] * 3, points + indices[i * 3 + 1] * 3,
+				points + indices[i * 3 + 2] * 3);
+		}
+	}
+
+#ifdef M3D_X86
+	// shuffles between packed xyz points and x, y, z registers. they only move
+	// floats within 128 bit lanes, so the same code works on four points in an
+	// __m128 and on two groups of four in an __m256
+#define M3D_DEINTERLEAVE(shuffle, r0, r1, r2, x, y, z) \
+	x = shuffle(shuffle(r0, r1, _MM_SHUFFLE(2, 1, 3, 0)), shuffle(r1, r2, _MM_SHUFFLE(0, 1, 0, 2)), _MM_SHUFFLE(2, 0, 1, 0)); \
+	y = shuffle(shuffle(r0, r1, _MM_SHUFFLE(3, 0, 1, 1)), shuffle(r1, r2, _MM_SHUFFLE(0, 2, 0, 3)), _MM_SHUFFLE(2, 0, 2, 0)); \
+	z = shuffle(shuffle(r0, r1, _MM_SHUFFLE(1, 1, 2, 2)), shuffle(r2, r2, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0))
+#define M3D_INTERLEAVE(shuffle, x, y, z, r0, r1, r2) \
+	r0 = shuffle(shuffle(x, y, _MM_SHUFFLE(0, 0, 0, 0)), shuffle(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0)); \
+	r1 = shuffle(shuffle(y, z, _MM_SHUFFLE(1, 1, 1, 1)), shuffle(x, y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0)); \
+	r2 = shuffle(shuffle(z, x, _MM_SHUFFLE(3, 3, 2, 2)), shuffle(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0))
+
+	// SSE2: one product column per register, four points per pass
+
+	M3D_TARGET("sse2") void MultiplySSE2(float* products, const float* a, size_t aStride, const float* b, size_t count)
+	{
+		for (size_t i = 0; i < count; i++, a += aStride, b += 16, products += 16)
+		{
+			__m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + 4), a2 = _mm_loadu_ps(a + 8), a3 = _mm_loadu_ps(a + 12);
+			for (int col = 0; col < 4; col++)
+			{
+				const float* bc = b + col * 4;
+				__m128 p = _mm_mul_ps(a0, _mm_set1_ps(bc[0]));
+				p = _mm_add_ps(p, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+				p = _mm_add_ps(p, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+				p = _mm_add_ps(p, _mm_mul_ps(a3, _mm_set1_ps(bc[3])));
+				_mm_storeu_ps(products + col * 4, p);
+			}
+		}
+	}
+	M3D_TARGET("sse2") void TransformSSE2(float* vOut, const float* v, const float* m, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const float* in = v + i * 3;
+			float* out = vOut + i * 3;
+			__m128 r0 = _mm_loadu_ps(in), r1 = _mm_loadu_ps(in + 4), r2 = _mm_loadu_ps(in + 8);
+			__m128 x, y, z;
+			M3D_DEINTERLEAVE(_mm_shuffle_ps, r0, r1, r2, x, y, z);
+			__m128 ox = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0]), x), _mm_mul_ps(_mm_set1_ps(m[4]), y)),
+				_mm_mul_ps(_mm_set1_ps(m[8]), z)), _mm_set1_ps(m[12]));
+			__m128 oy = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[1]), x), _mm_mul_ps(_mm_set1_ps(m[5]), y)),
+				_mm_mul_ps(_mm_set1_ps(m[9]), z)), _mm_set1_ps(m[13]));
+			__m128 oz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[2]), x), _mm_mul_ps(_mm_set1_ps(m[6]), y)),
+				_mm_mul_ps(_mm_set1_ps(m[10]), z)), _mm_set1_ps(m[14]));
+			M3D_INTERLEAVE(_mm_shuffle_ps, ox, oy, oz, r0, r1, r2);
+			_mm_storeu_ps(out, r0);
+			_mm_storeu_ps(out + 4, r1);
+			_mm_storeu_ps(out + 8, r2);
+		}
+		TransformScalar(vOut + i * 3, v + i * 3, m, count - i);
+	}
+	// three floats into x, y, z of a register, without reading past the point
+	M3D_TARGET("sse2") inline __m128 LoadPoint(const float* p)
+	{
+		return _mm_movelh_ps(_mm_castpd_ps(_mm_load_sd((const double*)p)), _mm_load_ss(p + 2));
+	}
+	// one triangle per register: the indexed loads cost more than the cross product,
+	// so regrouping four triangles into x, y, z registers does not pay off here
+	M3D_TARGET("sse2") void NormalSSE2(float* result, const float* points, const unsigned int* indices, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 1 < count; i++) // the last one is stored on its own, the four float store would overrun
+		{
+			const unsigned int* t = indices + i * 3;
+			__m128 p0 = LoadPoint(points + t[0] * 3), p1 = LoadPoint(points + t[1] * 3), p2 = LoadPoint(points + t[2] * 3);
+			__m128 u = _mm_sub_ps(p0, p1), w = _mm_sub_ps(p1, p2);
+			// u.yzx * w.zxy - w.yzx * u.zxy; y comes out as u2*w0 - u0*w2, which is the
+			// same float as m3dCrossProduct's -u0*w2 + w0*u2
+			__m128 n = _mm_sub_ps(
+				_mm_mul_ps(_mm_shuffle_ps(u, u, _MM_SHUFFLE(3, 0, 2, 1)), _mm_shuffle_ps(w, w, _MM_SHUFFLE(3, 1, 0, 2))),
+				_mm_mul_ps(_mm_shuffle_ps(w, w, _MM_SHUFFLE(3, 0, 2, 1)), _mm_shuffle_ps(u, u, _MM_SHUFFLE(3, 1, 0, 2))));
+			_mm_storeu_ps(result + i * 3, n);
+		}
+		NormalScalar(result + i * 3, points, indices + i * 3, count - i);
+	}
+
+	// AVX2: two product columns per register, eight points per pass. normals stay
+	// on the SSE2 kernel, the wider registers do not help their loads
+
+	M3D_TARGET("avx2") void MultiplyAVX2(float* products, const float* a, size_t aStride, const float* b, size_t count)
+	{
+		for (size_t i = 0; i < count; i++, a += aStride, b += 16, products += 16)
+		{
+			__m256 a0 = _mm256_broadcast_ps((const __m128*)a), a1 = _mm256_broadcast_ps((const __m128*)(a + 4));
+			__m256 a2 = _mm256_broadcast_ps((const __m128*)(a + 8)), a3 = _mm256_broadcast_ps((const __m128*)(a + 12));
+			for (int col = 0; col < 4; col += 2)
+			{
+				// columns col and col + 1 of b; each lane splats its own column's element
+				__m256 bc = _mm256_loadu_ps(b + col * 4);
+				__m256 p = _mm256_mul_ps(a0, _mm256_shuffle_ps(bc, bc, _MM_SHUFFLE(0, 0, 0, 0)));
+				p = _mm256_add_ps(p, _mm256_mul_ps(a1, _mm256_shuffle_ps(bc, bc, _MM_SHUFFLE(1, 1, 1, 1))));
+				p = _mm256_add_ps(p, _mm256_mul_ps(a2, _mm256_shuffle_ps(bc, bc, _MM_SHUFFLE(2, 2, 2, 2))));
+				p = _mm256_add_ps(p, _mm256_mul_ps(a3, _mm256_shuffle_ps(bc, bc, _MM_SHUFFLE(3, 3, 3, 3))));
+				_mm256_storeu_ps(products + col * 4, p);
+			}
+		}
+	}
+	M3D_TARGET("avx2") inline __m256 Load2x128(const float* low, const float* high)
+	{
+		return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(low)), _mm_loadu_ps(high), 1);
+	}
+	M3D_TARGET("avx2") inline void Store2x128(float* low, float* high, __m256 r)
+	{
+		_mm_storeu_ps(low, _mm256_castps256_ps128(r));
+		_mm_storeu_ps(high, _mm256_extractf128_ps(r, 1));
+	}
+	M3D_TARGET("avx2") void TransformAVX2(float* vOut, const float* v, const float* m, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			// points 0-3 in the low lane, 4-7 in the high lane
+			const float* in = v + i * 3;
+			float* out = vOut + i * 3;
+			__m256 r0 = Load2x128(in, in + 12), r1 = Load2x128(in + 4, in + 16), r2 = Load2x128(in + 8, in + 20);
+			__m256 x, y, z;
+			M3D_DEINTERLEAVE(_mm256_shuffle_ps, r0, r1, r2, x, y, z);
+			__m256 ox = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[0]), x), _mm256_mul_ps(_mm256_set1_ps(m[4]), y)),
+				_mm256_mul_ps(_mm256_set1_ps(m[8]), z)), _mm256_set1_ps(m[12]));
+			__m256 oy = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[1]), x), _mm256_mul_ps(_mm256_set1_ps(m[5]), y)),
+				_mm256_mul_ps(_mm256_set1_ps(m[9]), z)), _mm256_set1_ps(m[13]));
+			__m256 oz = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[2]), x), _mm256_mul_ps(_mm256_set1_ps(m[6]), y)),
+				_mm256_mul_ps(_mm256_set1_ps(m[10]), z)), _mm256_set1_ps(m[14]));
+			M3D_INTERLEAVE(_mm256_shuffle_ps, ox, oy, oz, r0, r1, r2);
+			Store2x128(out, out + 12, r0);
+			Store2x128(out + 4, out + 16, r1);
+			Store2x128(out + 8, out + 20, r2);
+		}
+		TransformSSE2(vOut + i * 3, v + i * 3, m, count - i);
+	}
+#undef M3D_DEINTERLEAVE
+#undef M3D_INTERLEAVE
+
+	M3DSimdLevel DetectSimdLevel()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+		__cpuid(info, 1);
+		if (!(info[3] & (1 << 26))) { return M3D_SIMD_SCALAR; }
+		// AVX needs the OS to save the ymm registers (OSXSAVE and XCR0 bits 1-2)
+		bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+		if (avx && maxLeaf >= 7)
+		{
+			__cpuidex(info, 7, 0);
+			if (info[1] & (1 << 5)) { return M3D_SIMD_AVX2; }
+		}
+		return M3D_SIMD_SSE2;
+#else
+		// also checks that the OS saves the ymm registers
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) { return M3D_SIMD_AVX2; }
+		if (__builtin_cpu_supports("sse2")) { return M3D_SIMD_SSE2; }
+		return M3D_SIMD_SCALAR;
+#endif
+	}
+#else
+	M3DSimdLevel DetectSimdLevel() { return M3D_SIMD_SCALAR; }
+#endif
+
+	Kernels MakeKernels(M3DSimdLevel level)
+	{
+		Kernels k = { M3D_SIMD_SCALAR, MultiplyScalar, TransformScalar, NormalScalar };
+#ifdef M3D_X86
+		if (level >= M3D_SIMD_SSE2) { k = { M3D_SIMD_SSE2, MultiplySSE2, TransformSSE2, NormalSSE2 }; }
+		if (level >= M3D_SIMD_AVX2) { k = { M3D_SIMD_AVX2, MultiplyAVX2, TransformAVX2, NormalSSE2 }; }
+#endif
+		return k;
+	}
+
+	M3DSimdLevel SupportedLevel()
+	{
+		static const M3DSimdLevel supported = DetectSimdLevel();
+		return supported;
+	}
+	Kernels& ActiveKernels()
+	{
+		static Kernels active = MakeKernels(SupportedLevel());
+		return active;
+	}
+}
+
+M3DSimdLevel m3dGetSimdLevel(void)
+{
+	return ActiveKernels().level;
+}
+
+void m3dSetSimdLevel(M3DSimdLevel level)
+{
+	ActiveKernels() = MakeKernels(level < SupportedLevel() ? level : SupportedLevel());
+}
+
+const char* m3dGetSimdLevelName(M3DSimdLevel level)
+{
+	switch (level)
+	{
+	case M3D_SIMD_SSE2: return "sse2";
+	case M3D_SIMD_AVX2: return "avx2";
+	default: return "scalar";
+	}
+}
+
+void m3dMatrixMultiply44Batch(float* products, const float* a, size_t aStride, const float* b, size_t count)
+{
+	ActiveKernels().multiply(products, a, aStride, b, count);
+}
+
+void m3dTransformVector3Batch(float* vOut, const float* v, const M3DMatrix44f m, size_t count)
+{
+	ActiveKernels().transform(vOut, v, m, count);
+}
+
+void m3dFindNormalBatch(float* result, const float* points, const unsigned int* indices, size_t count)
+{
+	ActiveKernels().normal(result, points, indices, count);
+}